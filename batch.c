@@ -0,0 +1,348 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "stack.h"
+#include "hash.h"
+#include "outbuf.h"
+#include "snapshot.h"
+
+/* One program of a batch.
+ * out collects everything the program prints until it is its turn to be
+ *   written to stdout (from then on it writes there itself, see
+ *   batch_handoff); done is set (under the lock) once ret is known.
+ * batch and index say where the job sits in the output order.
+ */
+typedef struct batch_job_struct {
+  char *filename;
+  Outbuf *out;
+  int ret;
+  int done;
+  struct batch_struct *batch;
+  int index;
+} Batch_job;
+
+/* State shared by the workers of one batch_run.
+ * next is the index of the next job to hand out, and finished is
+ *   signalled each time a job is done.  printed is the index of the job
+ *   whose turn it is once everything before it is out on stdout, so that
+ *   job may write there directly.  All three are guarded by lock.
+ * base is the snapshot every job's Symbol Table is an overlay of, or NULL
+ */
+typedef struct batch_struct {
+  Batch_job *jobs;
+  int count;
+  int next;
+  int printed;
+  int kind;
+  Symtab *base;
+  Rpn_options *opts;
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+} Batch;
+
+/* Local Function Declarations */
+static void *batch_worker(void *arg);
+static void batch_run_job(Batch *batch, Batch_job *job);
+static int batch_handoff(void *arg);
+
+/* Creates a new, empty list of program files.
+ * Returns NULL on any memory errors.
+ */
+Batch_files *batch_files_initialize() {
+  Batch_files *files = malloc(sizeof(Batch_files));
+  if(files == NULL) {
+    return NULL;
+  }
+
+  files->count = 0;
+  files->capacity = BATCH_FILES_INITIAL;
+  files->names = malloc(files->capacity * sizeof(char *));
+  if(files->names == NULL) {
+    free(files);
+    return NULL;
+  }
+  return files;
+}
+
+/* Destroys a file list along with its copies of the names.
+ */
+void batch_files_destroy(Batch_files *files) {
+  int i = 0;
+
+  if(files == NULL) {
+    return;
+  }
+  for(i = 0; i < files->count; i++) {
+    free(files->names[i]);
+  }
+  free(files->names);
+  free(files);
+}
+
+/* Adds a copy of name to the end of the list.
+ * Returns 0 on success or -1 on memory errors.
+ */
+int batch_files_add(Batch_files *files, char *name) {
+  char **names = NULL;
+
+  if(files == NULL || name == NULL) {
+    return -1;
+  }
+  if(files->count == files->capacity) {
+    names = realloc(files->names, 2 * files->capacity * sizeof(char *));
+    if(names == NULL) {
+      return -1;
+    }
+    files->names = names;
+    files->capacity *= 2;
+  }
+
+  files->names[files->count] = strdup(name);
+  if(files->names[files->count] == NULL) {
+    return -1;
+  }
+  files->count++;
+  return 0;
+}
+
+/* Adds every file named in a manifest to the end of the list.
+ * The manifest has one filename per line; blank lines and lines starting
+ *   with # are skipped, as is the whitespace at either end of a name.
+ * Returns 0 on success or -1 if the manifest cannot be read.
+ */
+int batch_files_read_manifest(Batch_files *files, char *manifest) {
+  FILE *fp = NULL;
+  char *line = NULL;
+  char *name = NULL;
+  size_t size = 0;
+  ssize_t len = 0;
+  int ret = 0;
+
+  fp = fopen(manifest, "r");
+  if(fp == NULL) {
+    return -1;
+  }
+
+  while(ret == 0 && (len = getline(&line, &size, fp)) >= 0) {
+    //Trim the line down to the name
+    while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                      line[len - 1] == ' ' || line[len - 1] == '\t')) {
+      line[--len] = '\0';
+    }
+    name = line;
+    while(*name == ' ' || *name == '\t') {
+      name++;
+    }
+    if(*name == '\0' || *name == '#') {
+      continue;
+    }
+    ret = batch_files_add(files, name);
+  }
+
+  free(line);
+  fclose(fp);
+  return ret;
+}
+
+/* Returns the number of worker threads to use when none is asked for:
+ *   one per online processor.
+ */
+int batch_default_threads() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(cpus < 1) {
+    return 1;
+  }
+  return (cpus > BATCH_MAX_THREADS) ? BATCH_MAX_THREADS : (int)cpus;
+}
+
+/* Runs every program in files with rpn_run, on threads worker threads.
+ * Each program gets its own Stack and Symbol Table (of the given kind) and
+ *   its own in memory Outbuf, so programs never share any state.
+ *   If snapshot is not NULL it is loaded once, and each Symbol Table is
+ *   an overlay of it instead (see hash_initialize_overlay): programs see
+ *   its variables, but their writes stay their own.
+ * The output of each program is written to stdout as one block, in the
+ *   order of files, as soon as it and every program before it are done.
+ *   The program whose turn it is writes straight to stdout once its
+ *   output fills a small buffer, so only the programs behind it keep
+ *   theirs in memory.  The output is the same whatever the number of
+ *   threads.
+ * Returns the number of programs that failed, or -1 if the batch could
+ *   not be started.
+ */
+int batch_run(Batch_files *files, int kind, char *snapshot, Rpn_options *opts, int threads) {
+  Batch batch;
+  pthread_t *workers = NULL;
+  Outbuf *stdout_buf = NULL;
+  int started = 0;
+  int failed = 0;
+  int ready = 0;
+  int i = 0;
+
+  if(files == NULL || opts == NULL) {
+    return -1;
+  }
+  if(threads < 1) {
+    threads = 1;
+  }
+  if(threads > BATCH_MAX_THREADS) {
+    threads = BATCH_MAX_THREADS;
+  }
+  if(threads > files->count) {
+    threads = (files->count > 0) ? files->count : 1;
+  }
+
+  batch.count = files->count;
+  batch.next = 0;
+  batch.printed = 0;
+  batch.kind = kind;
+  batch.base = (snapshot != NULL) ? snapshot_load(snapshot) : NULL;
+  batch.opts = opts;
+  batch.jobs = calloc(files->count + 1, sizeof(Batch_job));
+  workers = malloc(threads * sizeof(pthread_t));
+  fflush(stdout);
+  stdout_buf = outbuf_initialize(STDOUT_FILENO);
+  if(batch.jobs == NULL || workers == NULL || stdout_buf == NULL ||
+     (snapshot != NULL && batch.base == NULL)) {
+    free(batch.jobs);
+    free(workers);
+    outbuf_destroy(stdout_buf);
+    hash_destroy(batch.base);
+    return -1;
+  }
+  for(i = 0; i < files->count; i++) {
+    batch.jobs[i].filename = files->names[i];
+    batch.jobs[i].batch = &batch;
+    batch.jobs[i].index = i;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.finished, NULL);
+
+  for(started = 0; started < threads; started++) {
+    if(pthread_create(&workers[started], NULL, batch_worker, &batch) != 0) {
+      break;
+    }
+  }
+  //Without any workers this thread has to run the whole batch itself
+  if(started == 0) {
+    batch_worker(&batch);
+  }
+
+  //Write out each program's output in turn, as soon as it is done
+  for(i = 0; i < batch.count; i++) {
+    pthread_mutex_lock(&batch.lock);
+    while(!batch.jobs[i].done) {
+      pthread_cond_wait(&batch.finished, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+
+    if(batch.jobs[i].out != NULL) {
+      outbuf_write(stdout_buf, batch.jobs[i].out->buf, batch.jobs[i].out->len);
+      outbuf_destroy(batch.jobs[i].out);
+    }
+    else {
+      outbuf_str(stdout_buf, "Critical Error in Parsing.  Exiting Program!\n");
+    }
+    if(batch.jobs[i].ret != 0) {
+      failed++;
+    }
+
+    //A next job still running may now write straight to stdout, once
+    //everything before it has gone out
+    pthread_mutex_lock(&batch.lock);
+    ready = (i + 1 < batch.count && !batch.jobs[i + 1].done);
+    pthread_mutex_unlock(&batch.lock);
+    if(ready) {
+      outbuf_flush(stdout_buf);
+      pthread_mutex_lock(&batch.lock);
+      batch.printed = i + 1;
+      pthread_mutex_unlock(&batch.lock);
+    }
+  }
+
+  for(i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  pthread_cond_destroy(&batch.finished);
+  pthread_mutex_destroy(&batch.lock);
+  outbuf_destroy(stdout_buf);
+  hash_destroy(batch.base);
+  free(workers);
+  free(batch.jobs);
+  return failed;
+}
+
+/* Local function run by each worker thread.
+ * Takes the next job until there are none left.
+ */
+static void *batch_worker(void *arg) {
+  Batch *batch = arg;
+  Batch_job *job = NULL;
+
+  while(1) {
+    pthread_mutex_lock(&batch->lock);
+    job = (batch->next < batch->count) ? &batch->jobs[batch->next++] : NULL;
+    pthread_mutex_unlock(&batch->lock);
+    if(job == NULL) {
+      return NULL;
+    }
+
+    batch_run_job(batch, job);
+
+    pthread_mutex_lock(&batch->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&batch->finished);
+    pthread_mutex_unlock(&batch->lock);
+  }
+}
+
+/* Local function to run one program into its own output buffer.
+ */
+static void batch_run_job(Batch *batch, Batch_job *job) {
+  Rpn_options opts = *batch->opts;
+  Stack_head *stack = stack_initialize();
+  Symtab *symtab = NULL;
+
+  if(batch->base != NULL) {
+    symtab = hash_initialize_overlay(batch->base);
+  }
+  else {
+    symtab = hash_initialize_kind(batch->kind);
+  }
+
+  job->ret = -1;
+  job->out = outbuf_initialize(OUTBUF_MEMORY);
+  outbuf_set_handoff(job->out, batch_handoff, job);
+  if(stack != NULL && symtab != NULL && job->out != NULL) {
+    opts.out = job->out;
+    job->ret = rpn_run(stack, symtab, job->filename, &opts);
+  }
+  else if(job->out != NULL) {
+    outbuf_str(job->out, "Critical Error in Parsing.  Exiting Program!\n");
+  }
+  stack_destroy(stack);
+  hash_destroy(symtab);
+}
+
+/* Local function asked by a job's output buffer each time it fills.
+ * Returns STDOUT_FILENO once it is the job's turn on stdout, so the rest
+ *   of its output is written there as it goes, or OUTBUF_MEMORY to keep
+ *   collecting it.
+ */
+static int batch_handoff(void *arg) {
+  Batch_job *job = arg;
+  int fd = OUTBUF_MEMORY;
+
+  pthread_mutex_lock(&job->batch->lock);
+  if(job->batch->printed == job->index) {
+    fd = STDOUT_FILENO;
+  }
+  pthread_mutex_unlock(&job->batch->lock);
+  return fd;
+}
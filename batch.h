@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "rpn.h"
+
+/* Most worker threads batch_run will start */
+#define BATCH_MAX_THREADS 256
+
+/* Starting room in a file list, which doubles as it fills */
+#define BATCH_FILES_INITIAL 16
+
+/* Batch File List
+ * The program files of a batch, in the order their output is printed.
+ * count is the number of files in names
+ * capacity is the number of files names has room for
+ * names holds a private copy of each filename
+ */
+typedef struct batch_files_struct {
+  int count;
+  int capacity;
+  char **names;
+} Batch_files;
+
+/* Batch Function Prototypes */
+Batch_files *batch_files_initialize();
+void batch_files_destroy(Batch_files *files);
+int batch_files_add(Batch_files *files, char *name);
+int batch_files_read_manifest(Batch_files *files, char *manifest);
+int batch_default_threads();
+int batch_run(Batch_files *files, int kind, char *snapshot, Rpn_options *opts, int threads);
+
+#endif
@@ -0,0 +1,255 @@
+/* Multi-threaded throughput of a symbol table shared by every thread.
+ * Fills a table with vars variables and then has 1, 2, 4, ... up to
+ * max_threads threads hammer it at once, each doing operations calls of
+ * one of these mixes:
+ *   read    hash_get_value of random variables
+ *   update  90% reads, 10% hash_put of random existing variables
+ *   grow    90% reads, 10% hash_put of new variables, so the table keeps
+ *           growing under the readers
+ * for two ways of sharing a table:
+ *   concurrent  a HASH_CONCURRENT table, called with no locking at all
+ *   locked      a HASH_CHAINED table behind one mutex; a plain table has
+ *               to lock even for reads, as a lookup may migrate chains
+ * Throughput is for all threads together, and scaling is relative to one
+ * thread of the same kind and mix.
+ *
+ * Usage: bench_ctab [operations] [vars] [max_threads]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hash.h"
+
+/* Operation Mix Structure
+ * write_pct percent of operations are hash_puts; they add new variables
+ * if grow is set and update existing ones otherwise
+ */
+typedef struct bench_mix_struct {
+  char *name;
+  int write_pct;
+  int grow;
+} Bench_mix;
+
+static Bench_mix mixes[] = {
+  { "read",   0,  0 },
+  { "update", 10, 0 },
+  { "grow",   10, 1 },
+};
+
+/* Bench Thread Structure
+ * What one thread works on.  lock is NULL for the concurrent table.
+ * sum adds up every value read, so the reads cannot be optimized away;
+ * failed counts puts that failed and reads of variables that are missing
+ * added counts the new variables put
+ */
+typedef struct bench_thread_struct {
+  pthread_t thread;
+  int id;
+  Symtab *symtab;
+  pthread_mutex_t *lock;
+  pthread_barrier_t *start;
+  Bench_mix *mix;
+  char (*names)[MAX_VAR_LEN];
+  int vars;
+  long ops;
+  long sum;
+  long failed;
+  long added;
+} Bench_thread;
+
+/* Returns the current time in nanoseconds */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Returns the next number of a xorshift generator */
+static unsigned int next_rand(unsigned int *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* Writes the n'th new variable name of thread id.  The buffer is bigger
+ *   than MAX_VAR_LEN only to keep the compiler quiet; the names stay
+ *   short enough to never be cut off.
+ */
+static void fresh_name(char *name, int id, long n) {
+  snprintf(name, 32, "t%dn%ld", id, n);
+}
+
+/* Runs one thread's operations against the shared table */
+static void *bench_worker(void *arg) {
+  Bench_thread *bt = arg;
+  unsigned int state = 2463534242U + bt->id * 7919;
+  char fresh[32];
+  char *var = NULL;
+  long i = 0;
+  int val = 0;
+  int ret = 0;
+
+  pthread_barrier_wait(bt->start);
+  for(i = 0; i < bt->ops; i++) {
+    var = bt->names[next_rand(&state) % bt->vars];
+    if((int)(next_rand(&state) % 100) < bt->mix->write_pct) {
+      //New names are unique to each thread, so every one is a real insert
+      if(bt->mix->grow) {
+        fresh_name(fresh, bt->id, bt->added++);
+        var = fresh;
+      }
+      if(bt->lock != NULL) {
+        pthread_mutex_lock(bt->lock);
+      }
+      ret = hash_put(bt->symtab, var, (int)i);
+      if(bt->lock != NULL) {
+        pthread_mutex_unlock(bt->lock);
+      }
+    }
+    else {
+      if(bt->lock != NULL) {
+        pthread_mutex_lock(bt->lock);
+      }
+      ret = hash_get_value(bt->symtab, var, &val);
+      if(bt->lock != NULL) {
+        pthread_mutex_unlock(bt->lock);
+      }
+      bt->sum += val;
+    }
+    bt->failed += (ret != 0);
+  }
+  return NULL;
+}
+
+/* Fills a new table of kind with the first vars names and has threads
+ *   threads run mix against it.
+ * Returns the throughput in millions of operations per second, or 0 if
+ *   anything failed.
+ */
+static double bench_run(int kind, Bench_mix *mix, char (*names)[MAX_VAR_LEN], int vars, long ops,
+                        int threads, long *sum) {
+  Symtab *symtab = hash_initialize_kind(kind);
+  Bench_thread *bt = calloc(threads, sizeof(Bench_thread));
+  pthread_mutex_t lock;
+  pthread_barrier_t start;
+  char fresh[32];
+  double begin = 0, ns = 0;
+  long failed = 0;
+  long expect = vars;
+  long n = 0;
+  int i = 0;
+
+  if(symtab == NULL || bt == NULL) {
+    hash_destroy(symtab);
+    free(bt);
+    return 0;
+  }
+  for(i = 0; i < vars; i++) {
+    hash_put(symtab, names[i], i);
+  }
+  pthread_mutex_init(&lock, NULL);
+  pthread_barrier_init(&start, NULL, threads + 1);
+
+  for(i = 0; i < threads; i++) {
+    bt[i].id = i;
+    bt[i].symtab = symtab;
+    bt[i].lock = (kind == HASH_CONCURRENT) ? NULL : &lock;
+    bt[i].start = &start;
+    bt[i].mix = mix;
+    bt[i].names = names;
+    bt[i].vars = vars;
+    bt[i].ops = ops;
+    pthread_create(&(bt[i].thread), NULL, bench_worker, &(bt[i]));
+  }
+  pthread_barrier_wait(&start);
+  begin = now_ns();
+  for(i = 0; i < threads; i++) {
+    pthread_join(bt[i].thread, NULL);
+  }
+  ns = now_ns() - begin;
+
+  //Every put must have landed: no Symbol may be lost to a racing grow
+  for(i = 0; i < threads; i++) {
+    *sum += bt[i].sum;
+    failed += bt[i].failed;
+    expect += bt[i].added;
+    for(n = 0; n < bt[i].added; n++) {
+      fresh_name(fresh, i, n);
+      failed += (hash_lookup(symtab, fresh) == NULL);
+    }
+  }
+  failed += (hash_get_size(symtab) != expect);
+
+  pthread_barrier_destroy(&start);
+  pthread_mutex_destroy(&lock);
+  hash_destroy(symtab);
+  free(bt);
+  if(failed != 0) {
+    return 0;
+  }
+  return ops * threads / ns * 1e3;
+}
+
+int main(int argc, char *argv[]) {
+  long ops = 1000000;
+  int vars = 10000;
+  int max = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  char (*names)[MAX_VAR_LEN] = NULL;
+  int kinds[] = { HASH_CONCURRENT, HASH_CHAINED };
+  double single = 0, mops = 0;
+  long sum = 0;
+  int k = 0, m = 0, t = 0, i = 0;
+
+  if(argc > 1) {
+    ops = atol(argv[1]);
+  }
+  if(argc > 2) {
+    vars = atoi(argv[2]);
+  }
+  if(argc > 3) {
+    max = atoi(argv[3]);
+  }
+  if(vars > 0) {
+    names = malloc(sizeof(*names) * vars);
+  }
+  if(names == NULL || ops <= 0 || max <= 0) {
+    printf("Usage: %s [operations] [vars] [max_threads]\n", argv[0]);
+    return 1;
+  }
+  for(i = 0; i < vars; i++) {
+    snprintf(names[i], MAX_VAR_LEN, "v%d", i);
+  }
+
+  printf("shared symbol table: %d vars, %ld operations per thread, up to %d threads (%ld cores)\n",
+         vars, ops, max, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("%-10s %-6s %7s %10s %7s\n", "kind", "mix", "threads", "Mops/s", "scaling");
+  for(k = 0; k < (int)(sizeof(kinds) / sizeof(kinds[0])); k++) {
+    for(m = 0; m < (int)(sizeof(mixes) / sizeof(mixes[0])); m++) {
+      //1, 2, 4, ... threads and then max itself
+      for(t = 1; t <= max; t = (t * 2 > max && t < max) ? max : t * 2) {
+        mops = bench_run(kinds[k], &mixes[m], names, vars, ops, t, &sum);
+        if(t == 1) {
+          single = mops;
+        }
+        if(mops == 0) {
+          printf("%-10s %-6s %7d     FAILED\n", (kinds[k] == HASH_CONCURRENT) ? "concurrent" : "locked",
+                 mixes[m].name, t);
+          continue;
+        }
+        printf("%-10s %-6s %7d %10.2f %6.2fx\n", (kinds[k] == HASH_CONCURRENT) ? "concurrent" : "locked",
+               mixes[m].name, t, mops, (single > 0) ? mops / single : 0);
+      }
+    }
+  }
+  printf("(check %ld)\n", sum);
+
+  free(names);
+  return 0;
+}
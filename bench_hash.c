@@ -0,0 +1,155 @@
+/* Insert, lookup and rehash throughput of the symbol table kinds.
+ * For each variable count and key length, fills a HASH_CHAINED and a
+ * HASH_OPEN table with that many variables and then measures:
+ *   put     inserting every variable (growing from an empty table)
+ *   get     hash_get of random variables (a copy that is then freed)
+ *   hit     hash_get_value of random variables that are all in the table
+ *   50/50   hash_get_value where half of the variables are missing
+ *   miss    hash_get_value of variables that are never in the table
+ *   rehash  hash_rehash of the full table to twice its capacity
+ * The chain and probe length histograms are printed for the largest tables.
+ *
+ * Usage: bench_hash [lookups] [max_vars]
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+
+/* Variable counts to measure */
+static int counts[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+
+/* Key lengths to measure (MAX_VAR_LEN - 1 is the longest a name can be) */
+static int lengths[] = { 4, 10, MAX_VAR_LEN - 1 };
+
+/* Returns the current time in nanoseconds */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Writes the i'th name of length len: the number padded out with x's.
+ * Names too short to hold the number are as long as the number needs.
+ */
+static void make_name(char *name, int i, int len) {
+  int digits = snprintf(name, MAX_VAR_LEN, "%d", i);
+  int pad = (len > digits) ? len - digits : 0;
+
+  memset(name, 'x', pad);
+  snprintf(name + pad, MAX_VAR_LEN - pad, "%d", i);
+}
+
+/* Does lookups reads of random names with hash_get_value.
+ * Names are drawn from the first n of names hit_pct percent of the time
+ *   and from misses (which are never in the table) otherwise.
+ * Returns the time taken per lookup in nanoseconds.
+ */
+static double bench_lookups(Symtab *symtab, char (*names)[MAX_VAR_LEN], char (*misses)[MAX_VAR_LEN],
+                            int n, long lookups, int hit_pct, long *sum) {
+  double start = 0;
+  char *var = NULL;
+  long i = 0;
+  int val = 0;
+
+  srand(1);
+  start = now_ns();
+  for(i = 0; i < lookups; i++) {
+    var = (rand() % 100 < hit_pct) ? names[rand() % n] : misses[rand() % n];
+    if(hash_get_value(symtab, var, &val) == 0) {
+      *sum += val;
+    }
+  }
+  return (now_ns() - start) / lookups;
+}
+
+/* Fills a new table of kind with the first n names and measures it.
+ * If stats is set the table's hash_print_stats histogram is printed too.
+ */
+static void bench_kind(char *name, int kind, int n, int len, long lookups, char (*names)[MAX_VAR_LEN],
+                       char (*misses)[MAX_VAR_LEN], int stats) {
+  Symtab *symtab = hash_initialize_kind(kind);
+  Symbol *sym = NULL;
+  double start = 0, put_ns = 0, get_ns = 0, hit_ns = 0, half_ns = 0, miss_ns = 0, rehash_ns = 0;
+  long gets = lookups / 4;
+  long sum = 0;
+  long i = 0;
+  int capacity = 0;
+
+  start = now_ns();
+  for(i = 0; i < n; i++) {
+    hash_put(symtab, names[i], (int)i);
+  }
+  put_ns = (now_ns() - start) / n;
+
+  srand(1);
+  start = now_ns();
+  for(i = 0; i < gets; i++) {
+    sym = hash_get(symtab, names[rand() % n]);
+    sum += sym->val;
+    symbol_free(sym);
+  }
+  get_ns = (now_ns() - start) / gets;
+
+  hit_ns = bench_lookups(symtab, names, misses, n, lookups, 100, &sum);
+  half_ns = bench_lookups(symtab, names, misses, n, lookups, 50, &sum);
+  miss_ns = bench_lookups(symtab, names, misses, n, lookups, 0, &sum);
+
+  capacity = hash_get_capacity(symtab);
+  if(stats) {
+    hash_print_stats(symtab, stdout);
+  }
+  start = now_ns();
+  hash_rehash(symtab, capacity * 2);
+  rehash_ns = now_ns() - start;
+
+  printf("%-8s %7d %3d %7.1f %7.1f %7.1f %7.1f %7.1f %9.3f %8d  (check %ld)\n",
+         name, n, len, put_ns, get_ns, hit_ns, half_ns, miss_ns, rehash_ns / 1e6,
+         capacity, sum);
+  hash_destroy(symtab);
+}
+
+int main(int argc, char *argv[]) {
+  long lookups = 1000000;
+  int max = counts[sizeof(counts) / sizeof(counts[0]) - 1];
+  int nlengths = sizeof(lengths) / sizeof(lengths[0]);
+  char (*names)[MAX_VAR_LEN] = NULL;
+  int i = 0, l = 0, n = 0, largest = 0;
+
+  if(argc > 1) {
+    lookups = atol(argv[1]);
+  }
+  if(argc > 2) {
+    max = atoi(argv[2]);
+  }
+  if(max > 0) {
+    names = malloc(sizeof(*names) * max * 2);
+  }
+  if(names == NULL || lookups <= 0) {
+    printf("Usage: %s [lookups] [max_vars]\n", argv[0]);
+    return 1;
+  }
+
+  printf("symbol table: %ld random lookups per test, times in ns/op (rehash in ms)\n", lookups);
+  printf("%-8s %7s %3s %7s %7s %7s %7s %7s %9s %8s\n",
+         "kind", "vars", "len", "put", "get", "hit", "50/50", "miss", "rehash", "cap");
+  for(l = 0; l < nlengths; l++) {
+    //names[max] onwards are never put in a table, so they always miss
+    for(i = 0; i < max * 2; i++) {
+      make_name(names[i], i, lengths[l]);
+    }
+    for(i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])) && counts[i] <= max; i++) {
+      n = counts[i];
+      largest = (l == nlengths - 1) && (i + 1 == (int)(sizeof(counts) / sizeof(counts[0])) || counts[i + 1] > max);
+      bench_kind("chained", HASH_CHAINED, n, lengths[l], lookups, names, names + max, largest);
+      bench_kind("open", HASH_OPEN, n, lengths[l], lookups, names, names + max, largest);
+    }
+  }
+
+  free(names);
+  return 0;
+}
@@ -0,0 +1,253 @@
+/* End to end throughput of the rpn pipeline.
+ * Generates a synthetic program (see gen.h), or reads the one given with -f,
+ * and runs it through rpn_run in each mode: quiet, full trace (written to
+ * /dev/null), compiled, optimized and parallel (compiled, on one thread per
+ * CPU).  Each mode is run repeats times on a
+ * fresh Stack and Symbol Table and the fastest run is reported.
+ *
+ * The results are printed as JSON so they can be tracked across versions:
+ * tokens/sec, ns/token, allocation counts for one run (malloc, calloc and
+ * realloc calls, and non-NULL frees) and the peak RSS of the process so far
+ * (which only grows, so later modes include earlier ones).
+ * Allocations are counted by wrapping malloc and friends at link time
+ * (see ALLOC_WRAP in the Makefile).
+ *
+ * Usage: bench_rpn [-r repeats] [-f program] [-k] [generator options]
+ *   -k uses the open addressing symbol table
+ *   generator options are those of rpngen
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "gen.h"
+#include "rpn.h"
+#include "program.h"
+
+/* The modes to measure */
+typedef struct bench_mode_struct {
+  char *name;
+  int trace;
+  int compiled;
+  int optimize;
+  int parallel;
+} Bench_mode;
+
+static Bench_mode modes[] = {
+  { "quiet", TRACE_QUIET, 0, 0, 0 },
+  { "traced", TRACE_FULL, 0, 0, 0 },
+  { "compiled", TRACE_QUIET, 1, 0, 0 },
+  { "optimized", TRACE_QUIET, 1, OPT_FOLD | OPT_DEAD_STORES, 0 },
+  { "parallel", TRACE_QUIET, 1, 0, -1 }
+};
+
+/* Allocation counters, kept by the malloc wrappers below */
+static long alloc_count = 0;
+static long free_count = 0;
+static long alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  alloc_count++;
+  alloc_bytes += size;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  alloc_count++;
+  alloc_bytes += count * size;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  alloc_count++;
+  alloc_bytes += size;
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+  if(ptr != NULL) {
+    free_count++;
+  }
+  __real_free(ptr);
+}
+
+/* Returns the current time in nanoseconds */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Returns the peak resident set size of the process so far, in KB */
+static long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/* Counts the tokens in a program file, as the tokenizer would split it */
+static long count_tokens(char *filename) {
+  FILE *fp = fopen(filename, "r");
+  long count = 0;
+  int in_token = 0;
+  int c = 0;
+
+  if(fp == NULL) {
+    return -1;
+  }
+  while((c = fgetc(fp)) != EOF) {
+    if(isspace(c)) {
+      in_token = 0;
+    }
+    else if(!in_token) {
+      in_token = 1;
+      count++;
+    }
+  }
+  fclose(fp);
+  return count;
+}
+
+/* Runs filename once in mode, writing its output to out.
+ * The allocation counters are left holding the counts for this run.
+ * Returns the time taken in nanoseconds, or -1 if the program failed.
+ */
+static double bench_once(Bench_mode *mode, int kind, char *filename, Outbuf *out) {
+  Rpn_options opts = { mode->trace, 1, mode->compiled, mode->optimize, out, NULL, mode->parallel };
+  Stack_head *stack = NULL;
+  Symtab *symtab = NULL;
+  double start = 0;
+  int ret = 0;
+
+  alloc_count = 0;
+  free_count = 0;
+  alloc_bytes = 0;
+  start = now_ns();
+  stack = stack_initialize();
+  symtab = hash_initialize_kind(kind);
+  ret = rpn_run(stack, symtab, filename, &opts);
+  stack_destroy(stack);
+  hash_destroy(symtab);
+  return (ret == 0) ? now_ns() - start : -1;
+}
+
+int main(int argc, char *argv[]) {
+  Gen_options gen;
+  char filename[] = "/tmp/bench_rpn_XXXXXX";
+  char *program = NULL;
+  FILE *fp = NULL;
+  Outbuf *out = NULL;
+  int nmodes = sizeof(modes) / sizeof(modes[0]);
+  int repeats = 3;
+  int kind = HASH_CHAINED;
+  int fd = -1;
+  int devnull = -1;
+  long tokens = 0;
+  long allocs = 0, frees = 0, bytes = 0;
+  double best = 0, ns = 0;
+  int i = 0, m = 0, r = 0;
+
+  gen_default_options(&gen);
+  gen.tokens = 1000000;
+  for(m = 0; m < nmodes; m++) {
+    if(modes[m].parallel < 0) {
+      modes[m].parallel = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+  }
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-k") == 0) {
+      kind = HASH_OPEN;
+    }
+    else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+      repeats = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      program = argv[++i];
+    }
+    else if(i + 1 < argc && gen_parse_option(&gen, argv[i], argv[i + 1]) == 0) {
+      i++;
+    }
+    else {
+      printf("Usage: %s [-r repeats] [-f program] [-k] [-n tokens] [-v vars] "
+             "[-m +,-,*,/] [-a assign_pct] [-d depth] [-s seed]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  //Write the generated program to a temporary file for rpn_run to read
+  if(program == NULL) {
+    fd = mkstemp(filename);
+    fp = (fd < 0) ? NULL : fdopen(fd, "w");
+    if(fp == NULL || gen_program(&gen, fp) < 0) {
+      fprintf(stderr, "Error: Cannot Write File %s.  Exiting\n", filename);
+      return 1;
+    }
+    fclose(fp);
+    program = filename;
+  }
+  tokens = count_tokens(program);
+  devnull = open("/dev/null", O_WRONLY);
+  out = outbuf_initialize(devnull);
+  if(tokens <= 0 || devnull < 0 || out == NULL) {
+    fprintf(stderr, "Error: Cannot Read File %s.  Exiting\n", program);
+    return 1;
+  }
+
+  printf("{\n  \"benchmark\": \"rpn\",\n");
+  if(fd >= 0) {
+    printf("  \"program\": { \"tokens\": %ld, \"vars\": %d, \"mix\": [%d, %d, %d, %d], "
+           "\"assign_pct\": %d, \"depth\": %d, \"seed\": %lu },\n",
+           tokens, gen.vars, gen.mix[0], gen.mix[1], gen.mix[2], gen.mix[3],
+           gen.assign_pct, gen.depth, gen.seed);
+  }
+  else {
+    printf("  \"program\": { \"tokens\": %ld, \"file\": \"%s\" },\n", tokens, program);
+  }
+  printf("  \"symtab\": \"%s\",\n  \"repeats\": %d,\n  \"modes\": [\n",
+         (kind == HASH_OPEN) ? "open" : "chained", repeats);
+
+  for(m = 0; m < nmodes; m++) {
+    best = -1;
+    for(r = 0; r < repeats; r++) {
+      ns = bench_once(&modes[m], kind, program, out);
+      outbuf_flush(out);
+      if(r == 0) {
+        allocs = alloc_count;
+        frees = free_count;
+        bytes = alloc_bytes;
+      }
+      if(ns >= 0 && (best < 0 || ns < best)) {
+        best = ns;
+      }
+    }
+    if(best < 0) {
+      fprintf(stderr, "Error: %s run of %s failed\n", modes[m].name, program);
+    }
+    printf("    { \"mode\": \"%s\", \"ok\": %s, \"seconds\": %.6f, \"tokens_per_sec\": %.0f, "
+           "\"ns_per_token\": %.2f, \"allocs\": %ld, \"frees\": %ld, \"bytes_allocated\": %ld, "
+           "\"peak_rss_kb\": %ld }%s\n",
+           modes[m].name, (best < 0) ? "false" : "true", best / 1e9,
+           (best > 0) ? tokens / (best / 1e9) : 0.0, (best > 0) ? best / tokens : 0.0,
+           allocs, frees, bytes, peak_rss_kb(), (m == nmodes - 1) ? "" : ",");
+  }
+  printf("  ]\n}\n");
+
+  outbuf_destroy(out);
+  close(devnull);
+  if(fd >= 0) {
+    unlink(filename);
+  }
+  return 0;
+}
@@ -0,0 +1,187 @@
+/* Push/pop/peek throughput of the operand stack.
+ * Compares the array-backed Stack_head (by value and through the older
+ * pointer API) against the linked list of Nodes it replaced, at a range of
+ * stack depths (or just the one given).  The peek test reads the top of a
+ * stack of each depth with stack_peek.
+ *
+ * Usage: bench_stack [operations] [depth]
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "node.h"
+#include "stack.h"
+
+/* The linked list stack that Stack_head used to be */
+typedef struct list_stack_struct {
+  int count;
+  Node *top;
+} List_stack;
+
+static int list_push(List_stack *stack, Token *tok) {
+  Node *node = node_create(tok);
+  if(node == NULL) {
+    return -1;
+  }
+  node->next = stack->top;
+  stack->top = node;
+  stack->count++;
+  return 0;
+}
+
+static Token *list_pop(List_stack *stack) {
+  Node *node = stack->top;
+  Token *tok = NULL;
+  if(node == NULL) {
+    return NULL;
+  }
+  tok = node->tok;
+  stack->top = node->next;
+  stack->count--;
+  node_free(node);
+  return tok;
+}
+
+/* Returns the current time in nanoseconds */
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Stack depths to measure when none is given */
+static int depths[] = { 1, 8, 64, 1024, 65536 };
+
+/* Prints one result line: operations are one push plus one pop, or one peek */
+static void report(char *name, int depth, long ops, double ns, long sum) {
+  printf("%-14s %6d %10.2f Mops/s %8.2f ns/op  (check %ld)\n",
+         name, depth, ops / ns * 1e3, ns / ops, sum);
+}
+
+/* Each round pushes depth tokens then pops them all */
+static void bench_list(long ops, int depth) {
+  List_stack stack = { 0, NULL };
+  long sum = 0;
+  long done = 0;
+  int i = 0;
+  double start = now_ns();
+
+  while(done < ops) {
+    for(i = 0; i < depth; i++) {
+      list_push(&stack, token_create_value(i));
+    }
+    for(i = 0; i < depth; i++) {
+      Token *tok = list_pop(&stack);
+      sum += tok->value;
+      token_free(tok);
+    }
+    done += depth;
+  }
+  report("list", depth, done, now_ns() - start, sum);
+}
+
+static void bench_array_ptr(long ops, int depth) {
+  Stack_head *stack = stack_initialize();
+  long sum = 0;
+  long done = 0;
+  int i = 0;
+  double start = now_ns();
+
+  while(done < ops) {
+    for(i = 0; i < depth; i++) {
+      stack_push(stack, token_create_value(i));
+    }
+    for(i = 0; i < depth; i++) {
+      Token *tok = stack_pop(stack);
+      sum += tok->value;
+      token_free(tok);
+    }
+    done += depth;
+  }
+  report("array (ptr)", depth, done, now_ns() - start, sum);
+  stack_destroy(stack);
+}
+
+static void bench_array_value(long ops, int depth) {
+  Stack_head *stack = stack_initialize();
+  Token tok;
+  long sum = 0;
+  long done = 0;
+  int i = 0;
+  double start = now_ns();
+
+  tok.type = TYPE_VALUE;
+  while(done < ops) {
+    for(i = 0; i < depth; i++) {
+      tok.value = i;
+      stack_push_value(stack, &tok);
+    }
+    for(i = 0; i < depth; i++) {
+      stack_pop_value(stack, &tok);
+      sum += tok.value;
+    }
+    done += depth;
+  }
+  report("array (value)", depth, done, now_ns() - start, sum);
+  stack_destroy(stack);
+}
+
+/* Fills a stack depth deep, then peeks at the top ops times */
+static void bench_array_peek(long ops, int depth) {
+  Stack_head *stack = stack_initialize();
+  Token tok;
+  long sum = 0;
+  long i = 0;
+  double start = 0;
+
+  tok.type = TYPE_VALUE;
+  for(i = 0; i < depth; i++) {
+    tok.value = (int)i;
+    stack_push_value(stack, &tok);
+  }
+
+  start = now_ns();
+  for(i = 0; i < ops; i++) {
+    sum += stack_peek(stack)->value;
+    //Keep the compiler from hoisting the peek out of the loop
+    stack->items[stack->count - 1].value = (int)i;
+  }
+  report("array (peek)", depth, ops, now_ns() - start, sum);
+  stack_destroy(stack);
+}
+
+int main(int argc, char *argv[]) {
+  long ops = 10000000;
+  int depth = 0;
+  int i = 0;
+
+  if(argc > 1) {
+    ops = atol(argv[1]);
+  }
+  if(argc > 2) {
+    depth = atoi(argv[2]);
+  }
+  if(ops <= 0 || depth < 0 || (argc > 2 && depth == 0)) {
+    printf("Usage: %s [operations] [depth]\n", argv[0]);
+    return 1;
+  }
+
+  printf("stack push/pop and peek: %ld operations per test\n", ops);
+  printf("%-14s %6s\n", "stack", "depth");
+  for(i = 0; i < (int)(sizeof(depths) / sizeof(depths[0])); i++) {
+    if(depth != 0) {
+      depths[i] = depth;
+    }
+    bench_list(ops, depths[i]);
+    bench_array_ptr(ops, depths[i]);
+    bench_array_value(ops, depths[i]);
+    bench_array_peek(ops, depths[i]);
+    if(depth != 0) {
+      break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,542 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "hash.h"
+
+/* Local Function Declarations */
+static Cache_entry **cache_bucket(Program_cache *cache, unsigned long long hash);
+static Cache_entry *cache_find(Program_cache *cache, unsigned long long hash, char *source, int len, int flags);
+static void cache_unlink(Program_cache *cache, Cache_entry *entry);
+static void cache_push_newest(Program_cache *cache, Cache_entry *entry);
+static void cache_evict(Program_cache *cache, size_t need);
+static void cache_grow(Program_cache *cache);
+static size_t cache_cost(int len, Program *prog);
+static void cache_entry_free(Cache_entry *entry);
+static Program *cache_read_program(FILE *fp);
+
+/* Creates a new, empty cache that keeps at most budget bytes of programs.
+ * Returns NULL on any memory errors.
+ */
+Program_cache *cache_initialize(size_t budget) {
+  Program_cache *cache = malloc(sizeof(Program_cache));
+  if(cache == NULL) {
+    return NULL;
+  }
+
+  cache->budget = budget;
+  cache->used = 0;
+  cache->count = 0;
+  cache->bucket_count = CACHE_BUCKETS_INITIAL;
+  cache->buckets = calloc(CACHE_BUCKETS_INITIAL, sizeof(Cache_entry *));
+  cache->newest = NULL;
+  cache->oldest = NULL;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->evictions = 0;
+  if(cache->buckets == NULL) {
+    free(cache);
+    return NULL;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  return cache;
+}
+
+/* Destroys the cache and every program in it.
+ * No entry may still be acquired.
+ */
+void cache_destroy(Program_cache *cache) {
+  Cache_entry *walker = NULL;
+  Cache_entry *older = NULL;
+
+  if(cache == NULL) {
+    return;
+  }
+  for(walker = cache->newest; walker != NULL; walker = older) {
+    older = walker->older;
+    cache_entry_free(walker);
+  }
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->buckets);
+  free(cache);
+}
+
+/* Hashes len bytes of program source (64 bit FNV-1a) */
+unsigned long long cache_hash(char *source, int len) {
+  unsigned long long hash = CACHE_FNV_OFFSET;
+  int i = 0;
+
+  for(i = 0; i < len; i++) {
+    hash ^= (unsigned char)source[i];
+    hash *= CACHE_FNV_PRIME;
+  }
+  return hash;
+}
+
+/* Looks up the program compiled from len bytes of source with flags.
+ * On a hit the entry is marked most recently used and acquired: its
+ *   Program may be run (but not changed) until cache_release.
+ * Returns NULL on a miss.
+ */
+Cache_entry *cache_acquire(Program_cache *cache, char *source, int len, int flags) {
+  unsigned long long hash = 0;
+  Cache_entry *entry = NULL;
+
+  if(cache == NULL || source == NULL || len < 0) {
+    return NULL;
+  }
+  hash = cache_hash(source, len);
+
+  pthread_mutex_lock(&cache->lock);
+  entry = cache_find(cache, hash, source, len, flags);
+  if(entry != NULL) {
+    cache->hits++;
+    entry->refs++;
+    cache_unlink(cache, entry);
+    cache_push_newest(cache, entry);
+  }
+  else {
+    cache->misses++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return entry;
+}
+
+/* Adds prog, compiled from len bytes of source with flags, to the cache.
+ * The cache takes ownership of prog.  Least recently used programs are
+ *   evicted to make room; a program bigger than the whole budget is not
+ *   kept at all.  If another run added the same source first, its
+ *   program is used and prog is destroyed.
+ * Returns the entry acquired (see cache_acquire), or NULL on memory
+ *   errors (prog is destroyed).
+ */
+Cache_entry *cache_insert(Program_cache *cache, char *source, int len, int flags, Program *prog) {
+  unsigned long long hash = 0;
+  Cache_entry *entry = NULL;
+  Cache_entry **bucket = NULL;
+  Cache_entry *found = NULL;
+
+  if(cache == NULL || source == NULL || len < 0 || prog == NULL) {
+    program_destroy(prog);
+    return NULL;
+  }
+  hash = cache_hash(source, len);
+
+  entry = malloc(sizeof(Cache_entry));
+  if(entry != NULL) {
+    entry->source = malloc(len + 1);
+  }
+  if(entry == NULL || entry->source == NULL) {
+    free(entry);
+    program_destroy(prog);
+    return NULL;
+  }
+  memcpy(entry->source, source, len);
+  entry->source[len] = '\0';
+  entry->hash = hash;
+  entry->len = len;
+  entry->flags = flags;
+  entry->prog = prog;
+  entry->cost = cache_cost(len, prog);
+  entry->refs = 1;
+  entry->cached = 0;
+  entry->next = NULL;
+  entry->newer = NULL;
+  entry->older = NULL;
+
+  pthread_mutex_lock(&cache->lock);
+  for(bucket = cache_bucket(cache, hash); *bucket != NULL; bucket = &((*bucket)->next)) {
+    if((*bucket)->hash == hash && (*bucket)->len == len && (*bucket)->flags == flags &&
+       memcmp((*bucket)->source, source, len) == 0) {
+      break;
+    }
+  }
+  if(*bucket != NULL) {
+    //Someone else compiled it first; share theirs.  The bucket array may
+    //be grown as soon as the lock is dropped, so keep the entry itself
+    found = *bucket;
+    found->refs++;
+    cache_unlink(cache, found);
+    cache_push_newest(cache, found);
+    pthread_mutex_unlock(&cache->lock);
+    cache_entry_free(entry);
+    return found;
+  }
+
+  if(entry->cost <= cache->budget) {
+    cache_evict(cache, entry->cost);
+    if(cache->count >= cache->bucket_count) {
+      cache_grow(cache);
+    }
+    bucket = cache_bucket(cache, hash);
+    entry->next = *bucket;
+    *bucket = entry;
+    cache_push_newest(cache, entry);
+    entry->cached = 1;
+    cache->used += entry->cost;
+    cache->count++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return entry;
+}
+
+/* Releases an entry from cache_acquire or cache_insert.
+ * An entry that has been evicted (or was never kept) is freed once its
+ *   last run releases it.
+ */
+void cache_release(Program_cache *cache, Cache_entry *entry) {
+  int unused = 0;
+
+  if(cache == NULL || entry == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&cache->lock);
+  entry->refs--;
+  unused = (entry->refs == 0 && !entry->cached);
+  pthread_mutex_unlock(&cache->lock);
+
+  if(unused) {
+    cache_entry_free(entry);
+  }
+}
+
+/* Local function returning the bucket a hash belongs in */
+static Cache_entry **cache_bucket(Program_cache *cache, unsigned long long hash) {
+  return &(cache->buckets[hash & (cache->bucket_count - 1)]);
+}
+
+/* Local function to find an entry; the caller holds the lock */
+static Cache_entry *cache_find(Program_cache *cache, unsigned long long hash, char *source, int len, int flags) {
+  Cache_entry *walker = *cache_bucket(cache, hash);
+
+  while(walker != NULL) {
+    if(walker->hash == hash && walker->len == len && walker->flags == flags &&
+       memcmp(walker->source, source, len) == 0) {
+      return walker;
+    }
+    walker = walker->next;
+  }
+  return NULL;
+}
+
+/* Local function to take an entry out of the LRU list */
+static void cache_unlink(Program_cache *cache, Cache_entry *entry) {
+  if(entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  }
+  else {
+    cache->newest = entry->older;
+  }
+  if(entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  }
+  else {
+    cache->oldest = entry->newer;
+  }
+  entry->newer = NULL;
+  entry->older = NULL;
+}
+
+/* Local function to put an entry at the most recently used end */
+static void cache_push_newest(Program_cache *cache, Cache_entry *entry) {
+  entry->older = cache->newest;
+  entry->newer = NULL;
+  if(cache->newest != NULL) {
+    cache->newest->newer = entry;
+  }
+  cache->newest = entry;
+  if(cache->oldest == NULL) {
+    cache->oldest = entry;
+  }
+}
+
+/* Local function to evict the least recently used entries until need
+ *   more bytes fit in the budget.  Entries still in use are freed later,
+ *   by cache_release.
+ */
+static void cache_evict(Program_cache *cache, size_t need) {
+  Cache_entry *victim = NULL;
+  Cache_entry **bucket = NULL;
+
+  while(cache->oldest != NULL && cache->used + need > cache->budget) {
+    victim = cache->oldest;
+    cache_unlink(cache, victim);
+
+    for(bucket = cache_bucket(cache, victim->hash); *bucket != victim; bucket = &((*bucket)->next)) {
+    }
+    *bucket = victim->next;
+
+    victim->cached = 0;
+    cache->used -= victim->cost;
+    cache->count--;
+    cache->evictions++;
+    if(victim->refs == 0) {
+      cache_entry_free(victim);
+    }
+  }
+}
+
+/* Local function to double the number of buckets.
+ * If there is no memory for it the chains just get longer.
+ */
+static void cache_grow(Program_cache *cache) {
+  Cache_entry **old = cache->buckets;
+  Cache_entry *walker = NULL;
+  Cache_entry *next = NULL;
+  Cache_entry **bucket = NULL;
+  int old_count = cache->bucket_count;
+  int i = 0;
+
+  cache->buckets = calloc(old_count * 2, sizeof(Cache_entry *));
+  if(cache->buckets == NULL) {
+    cache->buckets = old;
+    return;
+  }
+  cache->bucket_count = old_count * 2;
+
+  for(i = 0; i < old_count; i++) {
+    for(walker = old[i]; walker != NULL; walker = next) {
+      next = walker->next;
+      bucket = cache_bucket(cache, walker->hash);
+      walker->next = *bucket;
+      *bucket = walker;
+    }
+  }
+  free(old);
+}
+
+/* Local function to work out how many bytes an entry takes up */
+static size_t cache_cost(int len, Program *prog) {
+  size_t cost = sizeof(Cache_entry) + len + 1 + sizeof(Program);
+
+  cost += sizeof(Instr) * prog->capacity;
+  cost += sizeof(*prog->names) * prog->slot_capacity;
+  if(prog->slots != NULL) {
+    cost += sizeof(Symtab) + sizeof(Symbol) * prog->slots->capacity;
+  }
+  return cost;
+}
+
+/* Local function to free an entry and its program */
+static void cache_entry_free(Cache_entry *entry) {
+  program_destroy(entry->prog);
+  free(entry->source);
+  free(entry);
+}
+
+/* Writes every program in the cache to path, oldest first, so that
+ *   cache_load rebuilds the same LRU order.
+ * The file is written beside path and then renamed over it, so a reader
+ *   never sees half of it.  It uses this machine's byte order.
+ * Returns 0 on success or -1 on any file error.
+ */
+int cache_save(Program_cache *cache, char *path) {
+  char *tmp = NULL;
+  FILE *fp = NULL;
+  Cache_entry *entry = NULL;
+  Program *prog = NULL;
+  int version = CACHE_FILE_VERSION;
+  int ok = 1;
+
+  if(cache == NULL || path == NULL) {
+    return -1;
+  }
+  tmp = malloc(strlen(path) + 5);
+  if(tmp == NULL) {
+    return -1;
+  }
+  sprintf(tmp, "%s.tmp", path);
+  fp = fopen(tmp, "wb");
+  if(fp == NULL) {
+    free(tmp);
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  ok = fwrite(CACHE_FILE_MAGIC, 1, strlen(CACHE_FILE_MAGIC), fp) == strlen(CACHE_FILE_MAGIC) &&
+       fwrite(&version, sizeof(int), 1, fp) == 1 &&
+       fwrite(&cache->count, sizeof(int), 1, fp) == 1;
+  for(entry = cache->oldest; ok && entry != NULL; entry = entry->newer) {
+    prog = entry->prog;
+    ok = fwrite(&entry->hash, sizeof(entry->hash), 1, fp) == 1 &&
+         fwrite(&entry->flags, sizeof(int), 1, fp) == 1 &&
+         fwrite(&entry->len, sizeof(int), 1, fp) == 1 &&
+         fwrite(entry->source, 1, entry->len, fp) == (size_t)entry->len &&
+         fwrite(&prog->count, sizeof(int), 1, fp) == 1 &&
+         fwrite(&prog->depth, sizeof(int), 1, fp) == 1 &&
+         fwrite(&prog->max_depth, sizeof(int), 1, fp) == 1 &&
+         fwrite(prog->code, sizeof(Instr), prog->count, fp) == (size_t)prog->count &&
+         fwrite(&prog->slot_count, sizeof(int), 1, fp) == 1 &&
+         fwrite(prog->names, sizeof(*prog->names), prog->slot_count, fp) == (size_t)prog->slot_count;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if(fclose(fp) != 0) {
+    ok = 0;
+  }
+  if(ok && rename(tmp, path) != 0) {
+    ok = 0;
+  }
+  if(!ok) {
+    remove(tmp);
+  }
+  free(tmp);
+  return ok ? 0 : -1;
+}
+
+/* Adds every program saved in path by cache_save to the cache.
+ * A missing file is not an error: the cache just starts out empty.
+ * Returns 0 on success or -1 if the file is not a valid cache file (any
+ *   programs before the bad one are kept).
+ */
+int cache_load(Program_cache *cache, char *path) {
+  char magic[sizeof(CACHE_FILE_MAGIC)];
+  FILE *fp = NULL;
+  Program *prog = NULL;
+  Cache_entry *entry = NULL;
+  unsigned long long hash = 0;
+  char *source = NULL;
+  int version = 0;
+  int count = 0;
+  int flags = 0;
+  int len = 0;
+  int ret = 0;
+  int i = 0;
+
+  if(cache == NULL || path == NULL) {
+    return -1;
+  }
+  fp = fopen(path, "rb");
+  if(fp == NULL) {
+    return 0;
+  }
+
+  if(fread(magic, 1, strlen(CACHE_FILE_MAGIC), fp) != strlen(CACHE_FILE_MAGIC) ||
+     memcmp(magic, CACHE_FILE_MAGIC, strlen(CACHE_FILE_MAGIC)) != 0 ||
+     fread(&version, sizeof(int), 1, fp) != 1 || version != CACHE_FILE_VERSION ||
+     fread(&count, sizeof(int), 1, fp) != 1 || count < 0) {
+    fclose(fp);
+    return -1;
+  }
+
+  for(i = 0; i < count && ret == 0; i++) {
+    if(fread(&hash, sizeof(hash), 1, fp) != 1 || fread(&flags, sizeof(int), 1, fp) != 1 ||
+       fread(&len, sizeof(int), 1, fp) != 1 || len < 0) {
+      ret = -1;
+      break;
+    }
+    source = malloc(len + 1);
+    if(source == NULL || fread(source, 1, len, fp) != (size_t)len ||
+       cache_hash(source, len) != hash) {
+      free(source);
+      ret = -1;
+      break;
+    }
+    prog = cache_read_program(fp);
+    if(prog == NULL) {
+      free(source);
+      ret = -1;
+      break;
+    }
+    entry = cache_insert(cache, source, len, flags, prog);
+    cache_release(cache, entry);
+    free(source);
+  }
+
+  fclose(fp);
+  return ret;
+}
+
+/* Local function to read back one Program written by cache_save.
+ * Every instruction is checked, so a damaged file cannot make program_run
+ *   read outside the program.
+ * Returns NULL if the Program is not valid or on memory errors.
+ */
+static Program *cache_read_program(FILE *fp) {
+  Program *prog = program_initialize();
+  Instr *code = NULL;
+  char (*names)[MAX_VAR_LEN] = NULL;
+  int count = 0;
+  int depth = 0;
+  int i = 0;
+
+  if(prog == NULL) {
+    return NULL;
+  }
+  if(fread(&count, sizeof(int), 1, fp) != 1 || count < 0 ||
+     fread(&prog->depth, sizeof(int), 1, fp) != 1 ||
+     fread(&prog->max_depth, sizeof(int), 1, fp) != 1 || prog->max_depth < 0) {
+    program_destroy(prog);
+    return NULL;
+  }
+  if(count > prog->capacity) {
+    code = realloc(prog->code, sizeof(Instr) * count);
+    if(code == NULL) {
+      program_destroy(prog);
+      return NULL;
+    }
+    prog->code = code;
+    prog->capacity = count;
+  }
+  prog->count = count;
+  if(fread(prog->code, sizeof(Instr), count, fp) != (size_t)count ||
+     fread(&count, sizeof(int), 1, fp) != 1 || count < 0) {
+    program_destroy(prog);
+    return NULL;
+  }
+
+  if(count > prog->slot_capacity) {
+    names = realloc(prog->names, sizeof(*names) * count);
+    if(names == NULL) {
+      program_destroy(prog);
+      return NULL;
+    }
+    prog->names = names;
+    prog->slot_capacity = count;
+  }
+  prog->slot_count = count;
+  if(fread(prog->names, sizeof(*prog->names), count, fp) != (size_t)count) {
+    program_destroy(prog);
+    return NULL;
+  }
+
+  //Intern the names again, just as compiling them would have
+  for(i = 0; i < prog->slot_count; i++) {
+    prog->names[i][MAX_VAR_LEN - 1] = '\0';
+    if(hash_put(prog->slots, prog->names[i], i) != 0) {
+      program_destroy(prog);
+      return NULL;
+    }
+  }
+  //program_run trusts max_depth and the slot numbers, so check both
+  for(i = 0; i < prog->count; i++) {
+    if(prog->code[i].op == OP_PUSH || prog->code[i].op == OP_LOAD) {
+      depth++;
+    }
+    else if(prog->code[i].op == OP_STORE) {
+      depth = (depth < 2) ? 0 : depth - 2;
+    }
+    else if(depth > 0) {
+      depth--;
+    }
+    if(prog->code[i].op < OP_PUSH || prog->code[i].op > OP_PRINT || depth > prog->max_depth ||
+       (prog->code[i].op == OP_LOAD && (prog->code[i].arg < 0 || prog->code[i].arg >= prog->slot_count))) {
+      program_destroy(prog);
+      return NULL;
+    }
+  }
+  return prog;
+}
+
+/* Prints the cache's hit, miss and eviction counts and memory use */
+void cache_print_stats(Program_cache *cache, FILE *out) {
+  if(cache == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&cache->lock);
+  fprintf(out, "Program cache: %ld hits, %ld misses, %ld evictions, %d programs, %lu of %lu bytes\n",
+          cache->hits, cache->misses, cache->evictions, cache->count,
+          (unsigned long)cache->used, (unsigned long)cache->budget);
+  pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,83 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "program.h"
+
+/* Memory budget used when none is given, in bytes */
+#define CACHE_DEFAULT_BUDGET (64L * 1024 * 1024)
+
+/* Starting number of buckets; there are always a power of two */
+#define CACHE_BUCKETS_INITIAL 64
+
+/* 64 bit FNV-1a constants used by cache_hash */
+#define CACHE_FNV_OFFSET 14695981039346656037ULL
+#define CACHE_FNV_PRIME  1099511628211ULL
+
+/* First bytes of a saved cache file, and its format version */
+#define CACHE_FILE_MAGIC   "RPNCACHE"
+#define CACHE_FILE_VERSION 1
+
+/* Cache Entry Structure
+ * One compiled program, found by the hash and length of its source and
+ * the program_optimize flags it was compiled with.
+ * source is a copy of the program text, so a hash collision can never
+ * -- hand back the wrong program
+ * cost is the number of bytes the entry counts against the budget
+ * refs is the number of runs using prog right now; an evicted entry is
+ * -- only freed once the last of them has released it
+ * cached is set while the entry is in the cache's table
+ * next chains the entries of a bucket; newer and older link the LRU list
+ */
+typedef struct cache_entry_struct {
+  unsigned long long hash;
+  int len;
+  int flags;
+  char *source;
+  Program *prog;
+  size_t cost;
+  int refs;
+  int cached;
+  struct cache_entry_struct *next;
+  struct cache_entry_struct *newer;
+  struct cache_entry_struct *older;
+} Cache_entry;
+
+/* Program Cache Structure
+ * Maps program sources to their compiled Programs, evicting the least
+ * recently used ones to stay within budget bytes.  It can be shared by
+ * any number of threads; lock guards everything in it.
+ * used is the number of bytes of the budget taken by count entries
+ * buckets is the hash table of bucket_count chains
+ * newest and oldest are the two ends of the LRU list
+ * hits, misses and evictions count cache_acquire results and evictions
+ */
+typedef struct program_cache_struct {
+  size_t budget;
+  size_t used;
+  int count;
+  int bucket_count;
+  Cache_entry **buckets;
+  Cache_entry *newest;
+  Cache_entry *oldest;
+  long hits;
+  long misses;
+  long evictions;
+  pthread_mutex_t lock;
+} Program_cache;
+
+/* Program Cache Function Prototypes */
+Program_cache *cache_initialize(size_t budget);
+void cache_destroy(Program_cache *cache);
+unsigned long long cache_hash(char *source, int len);
+Cache_entry *cache_acquire(Program_cache *cache, char *source, int len, int flags);
+Cache_entry *cache_insert(Program_cache *cache, char *source, int len, int flags, Program *prog);
+void cache_release(Program_cache *cache, Cache_entry *entry);
+int cache_save(Program_cache *cache, char *path);
+int cache_load(Program_cache *cache, char *path);
+void cache_print_stats(Program_cache *cache, FILE *out);
+
+#endif
@@ -1,28 +1,256 @@
 /* Do NOT Edit This File */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "rpn.h"
 #include "stack.h"
 #include "hash.h"
+#include "program.h"
+#include "batch.h"
+#include "cache.h"
+#include "snapshot.h"
+#include "server.h"
+
+/* Prints how to run the calculator */
+static void usage(char *name) {
+  printf("Usage: %s [-o] [-c] [-O] [-P N] [-q | -t N] [-j N] [-m manifest] [-b bindings.csv]\n", name);
+  printf("         [-K bytes] [-S cachefile] [-L snapshot] [-W snapshot] [filename ...]\n");
+  printf("       %s [-o] [-c] [-O] [-K bytes] [-S cachefile] [-L snapshot] -s socket\n", name);
+  printf("  -o    use the open addressing symbol table\n");
+  printf("  -c    compile the program to bytecode before running it\n");
+  printf("  -O    like -c, but fold constants and drop dead stores first\n");
+  printf("  -P N  like -c, but run independent parts of a large program on N threads\n");
+  printf("  -q    quiet: print only the output of print tokens\n");
+  printf("  -t N  trace only every Nth step\n");
+  printf("  -j N  run a batch of programs on N threads (default: one per CPU)\n");
+  printf("  -m F  add every program listed in F (one per line) to the batch\n");
+  printf("  -b F  run the program once per line of the CSV file F, whose first\n");
+  printf("        line names the variables; prints one line of output per run\n");
+  printf("        (not with -L, -W or -P; -O still optimizes the program)\n");
+  printf("  -K N  like -c, but keep compiled programs in an N byte cache so a\n");
+  printf("        program run again is not compiled again\n");
+  printf("  -S F  like -K, but load the cache from F first and save it back after\n");
+  printf("  -L F  start from the symbol table saved in the snapshot F (mapped, not\n");
+  printf("        read in; the table is open addressing, as with -o).  A batch or\n");
+  printf("        server shares it, giving each program its own layer for writes\n");
+  printf("  -W F  save the symbol table to the snapshot F after the program ends\n");
+  printf("        (with -O, stores are then kept even if nothing reads them)\n");
+  printf("  -s P  serve programs sent one per line to the Unix socket P, replying\n");
+  printf("        with their output and \"ok N\" or \"error N\" (N microseconds)\n");
+  printf("A filename of - runs the program streaming in on stdin, token by token\n");
+  printf("as it arrives, printing output as soon as it is ready.\n");
+  printf("Several files, -j or -m run a batch: each program has its own stack\n");
+  printf("and symbol table, and their output is printed in the order given.\n");
+  printf("A program waiting for its turn keeps its output in memory until then.\n");
+}
 
 /* Main RPN Calculator Program */
 int main(int argc, char *argv[]) {
-  /* Create a new Stack and Symbol Table */
-  Stack_head *stack = stack_initialize();
-  Symtab *symtab = hash_initialize();
+  /* Symbol Table kind, chosen with -o */
+  int kind = HASH_CHAINED;
+  /* Run options: full trace and no compiling unless asked for */
+  Rpn_options opts = { TRACE_FULL, 1, 0, 0, NULL, NULL, 0 };
   /* Set up the filename with the default sample */
   char filename[100] = "sample1.txt";
+  /* Batch of programs, used once there is more than one to run */
+  Batch_files *files = batch_files_initialize();
+  /* CSV of variable bindings, given with -b */
+  char *bindings = NULL;
+  /* Compiled program cache budget and file, given with -K and -S */
+  long budget = 0;
+  char *cachefile = NULL;
+  /* Symbol Table snapshots to load and to save, given with -L and -W */
+  char *snapshot = NULL;
+  char *save = NULL;
+  /* Unix socket to serve on, given with -s */
+  char *sockpath = NULL;
+  /* Whether the program comes from stdin, given as the filename - */
+  int stream = 0;
+  int batch = 0;
+  int threads = 0;
+  int ret = 0;
+  int i = 0;
+
+  if(files == NULL) {
+    return 1;
+  }
+
+  /* Options come first, then the filenames of the files to open */
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-o") == 0) {
+      kind = HASH_OPEN;
+    }
+    else if(strcmp(argv[i], "-c") == 0) {
+      opts.compiled = 1;
+    }
+    else if(strcmp(argv[i], "-O") == 0) {
+      opts.compiled = 1;
+      opts.optimize = OPT_FOLD | OPT_DEAD_STORES;
+    }
+    else if(strcmp(argv[i], "-P") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+      opts.compiled = 1;
+      opts.parallel = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-q") == 0) {
+      opts.trace = TRACE_QUIET;
+    }
+    else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+      opts.trace = TRACE_SAMPLED;
+      opts.sample = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+      batch = 1;
+      threads = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+      batch = 1;
+      if(batch_files_read_manifest(files, argv[++i]) != 0) {
+        printf("Error: Cannot Read File %s.  Exiting\n", argv[i]);
+        batch_files_destroy(files);
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      bindings = argv[++i];
+    }
+    else if(strcmp(argv[i], "-K") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0) {
+      budget = atol(argv[++i]);
+    }
+    else if(strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+      cachefile = argv[++i];
+    }
+    else if(strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+      snapshot = argv[++i];
+    }
+    else if(strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+      save = argv[++i];
+    }
+    else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      sockpath = argv[++i];
+    }
+    else if(strcmp(argv[i], "-") == 0) {
+      stream = 1;
+    }
+    else if(argv[i][0] == '-') {
+      usage(argv[0]);
+      batch_files_destroy(files);
+      return 1;
+    }
+    else if(batch_files_add(files, argv[i]) != 0) {
+      batch_files_destroy(files);
+      return 1;
+    }
+  }
 
-  /* One argument is allowed, a filename of the file to open */
-  if(argc == 2) {
-    strncpy(filename, argv[1], 100);
+  if((bindings != NULL || save != NULL) && (batch || files->count > 1)) {
+    usage(argv[0]);
+    batch_files_destroy(files);
+    return 1;
+  }
+  //Column runs have no Symbol Table to load or save, and run on one thread
+  if(bindings != NULL && (snapshot != NULL || save != NULL || opts.parallel > 0)) {
+    usage(argv[0]);
+    batch_files_destroy(files);
+    return 1;
+  }
+  if(stream && (batch || files->count > 0 || bindings != NULL || sockpath != NULL)) {
+    usage(argv[0]);
+    batch_files_destroy(files);
+    return 1;
+  }
+  if(sockpath != NULL && (batch || files->count > 0 || bindings != NULL || save != NULL)) {
+    usage(argv[0]);
+    batch_files_destroy(files);
+    return 1;
   }
 
-  /* Launch the rpn calculator */
-  rpn(stack, symtab, filename);
-  /* Clean up the calculator data structures */
-  stack_destroy(stack);
-  hash_destroy(symtab);
-  return 0;
+  if(save != NULL) {
+    /* Dead store elimination drops the final stores, which -W has to save */
+    opts.optimize &= ~OPT_DEAD_STORES;
+  }
+
+  if(snapshot != NULL) {
+    /* Check the snapshot once up front rather than failing every program */
+    Symtab *check = snapshot_load(snapshot);
+    if(check == NULL) {
+      printf("Error: Cannot Read File %s.  Exiting\n", snapshot);
+      batch_files_destroy(files);
+      return 1;
+    }
+    hash_destroy(check);
+  }
+
+  if(budget > 0 || cachefile != NULL) {
+    /* Cached programs are compiled ones */
+    opts.compiled = 1;
+    opts.cache = cache_initialize((budget > 0) ? budget : CACHE_DEFAULT_BUDGET);
+    if(opts.cache == NULL) {
+      batch_files_destroy(files);
+      return 1;
+    }
+    if(cachefile != NULL && cache_load(opts.cache, cachefile) != 0) {
+      fprintf(stderr, "Warning: Ignoring bad cache file %s\n", cachefile);
+    }
+  }
+
+  if(sockpath != NULL) {
+    /* Answer programs sent to the socket until stopped */
+    ret = server_run(sockpath, kind, snapshot, &opts);
+    if(ret != 0) {
+      printf("Error: Cannot Serve on %s.  Exiting\n", sockpath);
+      ret = 1;
+    }
+  }
+  else if(batch || files->count > 1) {
+    /* Run every program on a pool of worker threads */
+    if(threads == 0) {
+      threads = batch_default_threads();
+    }
+    ret = batch_run(files, kind, snapshot, &opts, threads);
+    ret = (ret == 0) ? 0 : 1;
+  }
+  else {
+    if(files->count == 1) {
+      strncpy(filename, files->names[0], 99);
+    }
+
+    if(bindings != NULL) {
+      /* Run the program over every binding at once */
+      ret = rpn_columns(filename, bindings, &opts);
+    }
+    else {
+      /* Create a new Stack and Symbol Table */
+      Stack_head *stack = stack_initialize();
+      Symtab *symtab = (snapshot != NULL) ? snapshot_load(snapshot) : hash_initialize_kind(kind);
+
+      /* Launch the rpn calculator */
+      if(stream) {
+        ret = rpn_stream(stack, symtab, STDIN_FILENO, &opts);
+      }
+      else {
+        ret = rpn_run(stack, symtab, filename, &opts);
+      }
+      if(ret == 0 && save != NULL && snapshot_save(symtab, save) != 0) {
+        fprintf(stderr, "Warning: Cannot Write File %s\n", save);
+      }
+      /* Clean up the calculator data structures */
+      stack_destroy(stack);
+      hash_destroy(symtab);
+    }
+  }
+  batch_files_destroy(files);
+
+  if(opts.cache != NULL) {
+    if(cachefile != NULL && cache_save(opts.cache, cachefile) != 0) {
+      fprintf(stderr, "Warning: Cannot Write File %s\n", cachefile);
+    }
+    cache_print_stats(opts.cache, stderr);
+    cache_destroy(opts.cache);
+  }
+  if(ret < 0) {
+    exit(-1);
+  }
+  return ret;
 }
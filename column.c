@@ -0,0 +1,564 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COLUMN_X86 1
+#endif
+
+#include "column.h"
+
+/* A value on the column stack.
+ * slot >= 0 is a reference to that variable, read when it is used (like
+ *   OP_LOAD); otherwise the value is the constant val if is_const is set,
+ *   or the column of stack scratch space at this depth.
+ */
+typedef struct column_value_struct {
+  int slot;
+  int is_const;
+  int val;
+} Column_value;
+
+/* Evaluation state for one block of bindings.
+ * rows is the number of bindings in the block (at most COLUMN_BLOCK)
+ * map gives the slot of each of the map_count CSV columns (-1 if unused),
+ * -- and csv_bound[i] is set if slot i is given by the CSV
+ * slots holds one column per program slot; bound[i] is set once slot i
+ * -- has a value (from the CSV, or from a store)
+ * scratch holds one column per stack depth, and tmp one column for
+ * -- spreading out a constant
+ * failed[r] is set once binding r has divided by zero
+ * outputs holds one column per print, in order (room for out_capacity)
+ * line is the getline buffer for reading the CSV
+ */
+typedef struct column_state_struct {
+  int rows;
+  int map_count;
+  int *map;
+  char *csv_bound;
+  int *slots;
+  char *bound;
+  int *scratch;
+  int *tmp;
+  char *failed;
+  int out_count;
+  int out_capacity;
+  int *outputs;
+  Column_value *stack;
+  char *line;
+  size_t line_size;
+} Column_state;
+
+/* Kernel for one operator: dst[i] = a[i] op b[i] for n values */
+typedef void (*Column_kernel)(int *dst, const int *a, const int *b, int n);
+
+/* Local Function Declarations */
+static void column_select_kernels();
+static int column_read_header(FILE *csv, Program *prog, Column_state *state);
+static int column_read_rows(FILE *csv, Column_state *state, int *line_no);
+static int column_eval(Program *prog, Column_state *state);
+static int *column_resolve(Column_state *state, Column_value *v, int depth, int *buf);
+static int column_add_output(Column_state *state, int *col);
+static void column_write(Column_state *state, Outbuf *out);
+static void column_div(int *dst, const int *a, const int *b, char *failed, int n);
+static int column_fold(int op, int a, int b, int *val);
+
+/* Kernels in use (indexed by op - OP_ADD, division is always scalar) */
+static Column_kernel kernels[3] = { NULL, NULL, NULL };
+static const char *kernel_isa = NULL;
+
+/* Scalar kernels.  The arithmetic is unsigned so that overflow wraps, just
+ *   as it does in the vector kernels.
+ */
+static void column_add_scalar(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i < n; i++) {
+    dst[i] = (int)((unsigned int)a[i] + (unsigned int)b[i]);
+  }
+}
+
+static void column_sub_scalar(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i < n; i++) {
+    dst[i] = (int)((unsigned int)a[i] - (unsigned int)b[i]);
+  }
+}
+
+static void column_mul_scalar(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i < n; i++) {
+    dst[i] = (int)((unsigned int)a[i] * (unsigned int)b[i]);
+  }
+}
+
+#ifdef COLUMN_X86
+
+/* AVX2 kernels: 8 values per instruction, scalar for the last few */
+__attribute__((target("avx2")))
+static void column_add_avx2(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi32(x, y));
+  }
+  column_add_scalar(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void column_sub_avx2(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_sub_epi32(x, y));
+  }
+  column_sub_scalar(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void column_mul_avx2(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_mullo_epi32(x, y));
+  }
+  column_mul_scalar(dst + i, a + i, b + i, n - i);
+}
+
+/* SSE4.1 kernels: 4 values per instruction (mullo_epi32 needs SSE4.1) */
+__attribute__((target("sse4.1")))
+static void column_add_sse(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(x, y));
+  }
+  column_add_scalar(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void column_sub_sse(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_sub_epi32(x, y));
+  }
+  column_sub_scalar(dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void column_mul_sse(int *dst, const int *a, const int *b, int n) {
+  int i = 0;
+  for(i = 0; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_mullo_epi32(x, y));
+  }
+  column_mul_scalar(dst + i, a + i, b + i, n - i);
+}
+
+#endif
+
+/* Local function to pick the widest kernels this CPU can run.
+ * The environment variable RPN_COLUMN_ISA (avx2, sse4.1 or scalar) can
+ *   ask for narrower ones, eg. to compare them.
+ */
+static void column_select_kernels() {
+  char *want = getenv("RPN_COLUMN_ISA");
+
+  if(kernel_isa != NULL) {
+    return;
+  }
+  kernels[0] = column_add_scalar;
+  kernels[1] = column_sub_scalar;
+  kernels[2] = column_mul_scalar;
+  kernel_isa = "scalar";
+
+#ifdef COLUMN_X86
+  __builtin_cpu_init();
+  if(want != NULL && strcmp(want, "scalar") == 0) {
+    return;
+  }
+  if(__builtin_cpu_supports("avx2") && (want == NULL || strcmp(want, "avx2") == 0)) {
+    kernels[0] = column_add_avx2;
+    kernels[1] = column_sub_avx2;
+    kernels[2] = column_mul_avx2;
+    kernel_isa = "avx2";
+  }
+  else if(__builtin_cpu_supports("sse4.1")) {
+    kernels[0] = column_add_sse;
+    kernels[1] = column_sub_sse;
+    kernels[2] = column_mul_sse;
+    kernel_isa = "sse4.1";
+  }
+#else
+  (void)want;
+#endif
+}
+
+/* Returns the name of the instruction set the kernels use */
+const char *column_isa() {
+  column_select_kernels();
+  return kernel_isa;
+}
+
+/* Runs prog over every binding in csv, writing one line per binding to out.
+ * Variables in the CSV header that the program never uses are ignored.
+ * Returns 0 on success.  Returns -1 if the CSV is malformed, the program
+ *   reads a variable that is neither bound nor assigned, underflows the
+ *   stack or assigns to a non-variable, or on any memory error.
+ */
+int column_run(Program *prog, FILE *csv, Outbuf *out) {
+  Column_state state;
+  int line_no = 1;
+  int slots = 0;
+  int ret = 0;
+
+  if(prog == NULL || csv == NULL || out == NULL) {
+    return -1;
+  }
+  column_select_kernels();
+
+  slots = prog->slot_count + 1;
+  memset(&state, 0, sizeof(state));
+  state.csv_bound = calloc(slots, sizeof(char));
+  state.slots = malloc(sizeof(int) * COLUMN_BLOCK * slots);
+  state.bound = calloc(slots, sizeof(char));
+  state.scratch = malloc(sizeof(int) * COLUMN_BLOCK * (prog->max_depth + 1));
+  state.tmp = malloc(sizeof(int) * COLUMN_BLOCK);
+  state.failed = malloc(COLUMN_BLOCK);
+  state.stack = malloc(sizeof(Column_value) * (prog->max_depth + 1));
+  state.out_capacity = 4;
+  state.outputs = malloc(sizeof(int) * COLUMN_BLOCK * state.out_capacity);
+  if(state.csv_bound == NULL || state.slots == NULL || state.bound == NULL ||
+     state.scratch == NULL || state.tmp == NULL || state.failed == NULL ||
+     state.stack == NULL || state.outputs == NULL) {
+    ret = -1;
+  }
+  if(ret == 0) {
+    ret = column_read_header(csv, prog, &state);
+  }
+
+  //Evaluate the bindings one block at a time
+  while(ret == 0) {
+    ret = column_read_rows(csv, &state, &line_no);
+    if(ret <= 0) {
+      break;
+    }
+    ret = column_eval(prog, &state);
+    if(ret == 0) {
+      column_write(&state, out);
+    }
+  }
+
+  free(state.map);
+  free(state.csv_bound);
+  free(state.slots);
+  free(state.bound);
+  free(state.scratch);
+  free(state.tmp);
+  free(state.failed);
+  free(state.stack);
+  free(state.outputs);
+  free(state.line);
+  return ret;
+}
+
+/* Local function to read the CSV header into state->map and csv_bound.
+ * Returns 0 on success or -1 on a missing header or memory errors.
+ */
+static int column_read_header(FILE *csv, Program *prog, Column_state *state) {
+  char *name = NULL;
+  char *save = NULL;
+  int capacity = 8;
+  int *grown = NULL;
+  int slot = 0;
+  int i = 0;
+
+  if(getline(&state->line, &state->line_size, csv) < 0) {
+    return -1;
+  }
+  state->map = malloc(sizeof(int) * capacity);
+  if(state->map == NULL) {
+    return -1;
+  }
+
+  for(name = strtok_r(state->line, ", \t\r\n", &save); name != NULL;
+      name = strtok_r(NULL, ", \t\r\n", &save)) {
+    if(state->map_count == capacity) {
+      grown = realloc(state->map, sizeof(int) * capacity * 2);
+      if(grown == NULL) {
+        return -1;
+      }
+      state->map = grown;
+      capacity *= 2;
+    }
+    //Only the first MAX_VAR_LEN - 1 characters of a name count
+    if(strlen(name) > MAX_VAR_LEN - 1) {
+      name[MAX_VAR_LEN - 1] = '\0';
+    }
+    slot = -1;
+    for(i = 0; i < prog->slot_count; i++) {
+      if(strcmp(prog->names[i], name) == 0) {
+        slot = i;
+        state->csv_bound[i] = 1;
+        break;
+      }
+    }
+    state->map[state->map_count++] = slot;
+  }
+  return 0;
+}
+
+/* Local function to read up to COLUMN_BLOCK bindings into the slot columns.
+ * Blank lines are skipped.
+ * Returns the number of bindings read, 0 at the end of the file or -1 if a
+ *   line does not have one integer per header name.
+ */
+static int column_read_rows(FILE *csv, Column_state *state, int *line_no) {
+  char *walker = NULL;
+  char *end = NULL;
+  long val = 0;
+  int rows = 0;
+  int i = 0;
+
+  while(rows < COLUMN_BLOCK && getline(&state->line, &state->line_size, csv) >= 0) {
+    (*line_no)++;
+    walker = state->line;
+    while(*walker == ' ' || *walker == '\t') {
+      walker++;
+    }
+    if(*walker == '\n' || *walker == '\r' || *walker == '\0') {
+      continue;
+    }
+
+    for(i = 0; i < state->map_count; i++) {
+      val = strtol(walker, &end, 10);
+      if(end == walker || val < INT_MIN || val > INT_MAX ||
+         (i + 1 < state->map_count && *end != ',')) {
+        fprintf(stderr, "Error: Bad binding on line %d\n", *line_no);
+        return -1;
+      }
+      if(state->map[i] >= 0) {
+        state->slots[state->map[i] * COLUMN_BLOCK + rows] = (int)val;
+      }
+      walker = end + 1;
+    }
+    rows++;
+  }
+
+  state->rows = rows;
+  return rows;
+}
+
+/* Local function to run the program over the current block.
+ * Returns 0 on success or -1 on any error that is the same for every
+ *   binding (see column_run); division by zero only fails its binding.
+ */
+static int column_eval(Program *prog, Column_state *state) {
+  Instr *code = prog->code;
+  Column_value *stack = state->stack;
+  int rows = state->rows;
+  int *a = NULL;
+  int *b = NULL;
+  int *dst = NULL;
+  int sp = 0;
+  int pc = 0;
+  int op = 0;
+  int val = 0;
+
+  memcpy(state->bound, state->csv_bound, prog->slot_count + 1);
+  memset(state->failed, 0, rows);
+  state->out_count = 0;
+
+  for(pc = 0; pc < prog->count; pc++) {
+    op = code[pc].op;
+    switch(op) {
+
+    case OP_PUSH:
+      stack[sp].slot = -1;
+      stack[sp].is_const = 1;
+      stack[sp].val = code[pc].arg;
+      sp++;
+      break;
+
+    case OP_LOAD:
+      stack[sp].slot = code[pc].arg;
+      stack[sp].is_const = 0;
+      sp++;
+      break;
+
+    case OP_STORE:
+      if(sp < 2 || stack[sp - 2].slot < 0) {
+        return -1;
+      }
+      dst = state->slots + stack[sp - 2].slot * COLUMN_BLOCK;
+      a = column_resolve(state, &stack[sp - 1], sp - 1, dst);
+      if(a == NULL) {
+        return -1;
+      }
+      if(a != dst) {
+        memcpy(dst, a, sizeof(int) * rows);
+      }
+      state->bound[stack[sp - 2].slot] = 1;
+      sp -= 2;
+      break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+      if(sp < 2) {
+        return -1;
+      }
+      //Two constants (after folding, only possible on errors) stay constant
+      if(stack[sp - 1].slot < 0 && stack[sp - 1].is_const &&
+         stack[sp - 2].slot < 0 && stack[sp - 2].is_const) {
+        if(column_fold(op, stack[sp - 2].val, stack[sp - 1].val, &val) != 0) {
+          memset(state->failed, 1, rows);
+        }
+        sp--;
+        stack[sp - 1].val = val;
+        break;
+      }
+      //Only one side can be a constant, so one tmp column is enough
+      b = column_resolve(state, &stack[sp - 1], sp - 1, state->tmp);
+      a = column_resolve(state, &stack[sp - 2], sp - 2, state->tmp);
+      if(a == NULL || b == NULL) {
+        return -1;
+      }
+      sp--;
+      dst = state->scratch + (sp - 1) * COLUMN_BLOCK;
+      if(op == OP_DIV) {
+        column_div(dst, a, b, state->failed, rows);
+      }
+      else {
+        kernels[op - OP_ADD](dst, a, b, rows);
+      }
+      stack[sp - 1].slot = -1;
+      stack[sp - 1].is_const = 0;
+      break;
+
+    case OP_PRINT:
+      if(sp < 1) {
+        return -1;
+      }
+      a = column_resolve(state, &stack[sp - 1], sp - 1, state->tmp);
+      if(a == NULL || column_add_output(state, a) != 0) {
+        return -1;
+      }
+      sp--;
+      break;
+
+    default:
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Local function to get the column holding a stack value.
+ * References give the slot's own column and results their scratch column
+ *   (depth is the value's place on the stack); constants are spread out
+ *   over buf.
+ * Returns NULL if the value is an unassigned variable.
+ */
+static int *column_resolve(Column_state *state, Column_value *v, int depth, int *buf) {
+  int i = 0;
+
+  if(v->slot >= 0) {
+    if(!state->bound[v->slot]) {
+      return NULL;
+    }
+    return state->slots + v->slot * COLUMN_BLOCK;
+  }
+  if(v->is_const) {
+    for(i = 0; i < state->rows; i++) {
+      buf[i] = v->val;
+    }
+    return buf;
+  }
+  return state->scratch + depth * COLUMN_BLOCK;
+}
+
+/* Local function to keep a copy of col as the next printed column.
+ * Returns 0 on success or -1 on memory errors.
+ */
+static int column_add_output(Column_state *state, int *col) {
+  int *grown = NULL;
+
+  if(state->out_count == state->out_capacity) {
+    grown = realloc(state->outputs, sizeof(int) * COLUMN_BLOCK * state->out_capacity * 2);
+    if(grown == NULL) {
+      return -1;
+    }
+    state->outputs = grown;
+    state->out_capacity *= 2;
+  }
+  memcpy(state->outputs + state->out_count * COLUMN_BLOCK, col, sizeof(int) * state->rows);
+  state->out_count++;
+  return 0;
+}
+
+/* Local function to write one line per binding of the current block */
+static void column_write(Column_state *state, Outbuf *out) {
+  int r = 0;
+  int k = 0;
+
+  for(r = 0; r < state->rows; r++) {
+    if(state->failed[r]) {
+      outbuf_write(out, "error\n", 6);
+      continue;
+    }
+    for(k = 0; k < state->out_count; k++) {
+      if(k > 0) {
+        outbuf_write(out, ",", 1);
+      }
+      outbuf_int(out, state->outputs[k * COLUMN_BLOCK + r]);
+    }
+    outbuf_write(out, "\n", 1);
+  }
+}
+
+/* Local function for division, which has no vector instruction.
+ * Bindings that divide by zero (or INT_MIN by -1, which would trap) are
+ *   marked as failed and get 0.
+ */
+static void column_div(int *dst, const int *a, const int *b, char *failed, int n) {
+  int i = 0;
+
+  for(i = 0; i < n; i++) {
+    if(b[i] == 0 || (a[i] == INT_MIN && b[i] == -1)) {
+      failed[i] = 1;
+      dst[i] = 0;
+    }
+    else {
+      dst[i] = a[i] / b[i];
+    }
+  }
+}
+
+/* Local function to work out a op b for two constants.
+ * Returns -1 (with val set to 0) if the division cannot be done.
+ */
+static int column_fold(int op, int a, int b, int *val) {
+  *val = 0;
+  switch(op) {
+    case OP_ADD: *val = (int)((unsigned int)a + (unsigned int)b); return 0;
+    case OP_SUB: *val = (int)((unsigned int)a - (unsigned int)b); return 0;
+    case OP_MUL: *val = (int)((unsigned int)a * (unsigned int)b); return 0;
+    default:
+      if(b == 0 || (a == INT_MIN && b == -1)) {
+        return -1;
+      }
+      *val = a / b;
+      return 0;
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <stdio.h>
+
+#include "program.h"
+#include "outbuf.h"
+
+/* Number of bindings evaluated together; each column holds this many */
+#define COLUMN_BLOCK 1024
+
+/* Columnar Evaluation
+ * Runs one compiled Program over many bindings of its input variables at
+ * once.  The bindings come from a CSV file: the first line names the
+ * variables, and every line after it gives one value for each of them.
+ *
+ * The program is run over COLUMN_BLOCK bindings at a time.  Every value on
+ * the stack is a whole column, so each + - * and / is one kernel applied
+ * across the block (AVX2 or SSE4.1 where the CPU has them, scalar loops
+ * otherwise).
+ *
+ * For each binding one line is written: the values the program printed,
+ * separated by commas, or "error" if that binding divided by zero.
+ */
+int column_run(Program *prog, FILE *csv, Outbuf *out);
+const char *column_isa();
+
+#endif
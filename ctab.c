@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "ctab.h"
+#include "stats.h"
+
+/* Concurrent variant of the symbol table.
+ * Any number of threads may look up and update variables at once, and
+ *   lookups never take a lock.  The slots hold pointers to Symbols from
+ *   symtab->pool, so a Symbol never moves once it is in the table: growing
+ *   copies the pointers into a new, bigger slot array and then publishes
+ *   that with a single atomic store (a read-copy-update swap).  A reader
+ *   that loaded the old array just finishes its probe there.
+ * A Symbol is filled in before its slot is published, and its name never
+ *   changes afterwards.  Values are read and written with atomics, so an
+ *   update of an existing variable does not lock either.
+ * Adding a variable or growing takes ctab->lock, so writers that add
+ *   variables run one at a time.  Symbols are never removed (until
+ *   hash_clear, which like hash_destroy must not race with anything).
+ */
+
+/* Allocates an empty generation of capacity slots (a power of two).
+ * Returns NULL on any memory errors.
+ */
+static Ctab_table *ctab_table_create(int capacity) {
+  Ctab_table *table = calloc(1, sizeof(Ctab_table) + sizeof(Symbol *) * capacity);
+
+  if(table == NULL) {
+    return NULL;
+  }
+  table->capacity = capacity;
+  table->retired = NULL;
+  return table;
+}
+
+/* Frees every generation table has replaced, keeping table itself */
+static void ctab_free_retired(Ctab_table *table) {
+  Ctab_table *walker = table->retired;
+  Ctab_table *next = NULL;
+
+  while(walker != NULL) {
+    next = walker->retired;
+    free(walker);
+    walker = next;
+  }
+  table->retired = NULL;
+}
+
+/* Returns the slot of table holding var, or the empty slot where it would
+ *   go.  Slots are loaded with acquire ordering so a Symbol seen here is
+ *   fully filled in.
+ */
+static int ctab_probe(Ctab_table *table, char *var, Symbol **found) {
+  int index = (int)(hash_code(var) & (table->capacity - 1));
+  Symbol *sym = NULL;
+
+  STATS_INC(probe_steps);
+  while((sym = __atomic_load_n(&(table->slots[index]), __ATOMIC_ACQUIRE)) != NULL &&
+        strcmp(sym->variable, var) != 0) {
+    index = (index + 1) & (table->capacity - 1);
+    STATS_INC(probe_steps);
+  }
+  *found = sym;
+  return index;
+}
+
+/* Makes a table of new_capacity holding every Symbol of the current one
+ *   and publishes it.  ctab->lock must be held.
+ * If new_capacity cannot hold every Symbol, or on any memory errors,
+ *   return -1 and leave the table as it was.
+ */
+static int ctab_grow(Symtab *symtab, int new_capacity) {
+  Ctab_table *old = symtab->ctab->table;
+  Ctab_table *table = NULL;
+  Symbol *sym = NULL;
+  int i = 0;
+
+  if(new_capacity <= symtab->size) {
+    return -1;
+  }
+  table = ctab_table_create(new_capacity);
+  if(table == NULL) {
+    return -1;
+  }
+  STATS_INC(rehashes);
+  STATS_TIMER(start);
+
+  //Nobody can see the new table yet, so it is filled without atomics
+  for(i = 0; i < old->capacity; i++) {
+    if(old->slots[i] != NULL) {
+      table->slots[ctab_probe(table, old->slots[i]->variable, &sym)] = old->slots[i];
+    }
+  }
+  table->retired = old;
+
+  __atomic_store_n(&(symtab->ctab->table), table, __ATOMIC_RELEASE);
+  __atomic_store_n(&(symtab->capacity), new_capacity, __ATOMIC_RELAXED);
+  STATS_REHASH_TIME(start);
+  return 0;
+}
+
+/* Sets up the lock and an empty table of the given capacity (a power of
+ *   two) in symtab.  Symbols come from symtab->pool, which must exist.
+ * On any memory errors, return -1.
+ */
+int ctab_initialize(Symtab *symtab, int capacity) {
+  symtab->ctab = malloc(sizeof(Ctab));
+  if(symtab->ctab == NULL) {
+    return -1;
+  }
+  symtab->ctab->table = ctab_table_create(capacity);
+  if(symtab->ctab->table == NULL) {
+    free(symtab->ctab);
+    symtab->ctab = NULL;
+    return -1;
+  }
+  pthread_mutex_init(&(symtab->ctab->lock), NULL);
+
+  symtab->size = 0;
+  symtab->capacity = capacity;
+  return 0;
+}
+
+/* Frees every table generation and the lock.  The Symbols belong to
+ *   symtab->pool.
+ */
+void ctab_destroy(Symtab *symtab) {
+  if(symtab->ctab == NULL) {
+    return;
+  }
+  ctab_free_retired(symtab->ctab->table);
+  free(symtab->ctab->table);
+  pthread_mutex_destroy(&(symtab->ctab->lock));
+  free(symtab->ctab);
+  symtab->ctab = NULL;
+}
+
+/* Empties the current table, returning its Symbols to the pool, and frees
+ *   the retired generations.
+ */
+void ctab_clear(Symtab *symtab) {
+  Ctab_table *table = symtab->ctab->table;
+  int i = 0;
+
+  for(i = 0; i < table->capacity; i++) {
+    if(table->slots[i] != NULL) {
+      symbol_free_pooled(symtab->pool, table->slots[i]);
+      table->slots[i] = NULL;
+    }
+  }
+  ctab_free_retired(table);
+  symtab->size = 0;
+}
+
+/* Finds the Symbol for var without locking.
+ * Returns NULL if var is not in the table.
+ */
+Symbol *ctab_lookup(Symtab *symtab, char *var) {
+  Symbol *sym = NULL;
+
+  ctab_probe(__atomic_load_n(&(symtab->ctab->table), __ATOMIC_ACQUIRE), var, &sym);
+  return sym;
+}
+
+/* Reads the value of a Symbol in a concurrent table */
+int ctab_get_value(Symbol *sym) {
+  return __atomic_load_n(&(sym->val), __ATOMIC_RELAXED);
+}
+
+/* Writes the value of a Symbol in a concurrent table */
+void ctab_set_value(Symbol *sym, int val) {
+  __atomic_store_n(&(sym->val), val, __ATOMIC_RELAXED);
+}
+
+/* Adds or updates var.  An update of a variable that is already there
+ *   does not lock; adding one does, growing the table first if the new
+ *   Symbol would take it past CTAB_MAX_LOAD.
+ * On any memory errors, return -1; otherwise return 0.
+ */
+int ctab_put(Symtab *symtab, char *var, int val) {
+  Ctab_table *table = NULL;
+  Symbol *sym = ctab_lookup(symtab, var);
+  int index = 0;
+
+  if(sym != NULL) {
+    ctab_set_value(sym, val);
+    return 0;
+  }
+
+  pthread_mutex_lock(&(symtab->ctab->lock));
+  //Another writer may have added var while we waited for the lock
+  table = symtab->ctab->table;
+  index = ctab_probe(table, var, &sym);
+  if(sym != NULL) {
+    ctab_set_value(sym, val);
+    pthread_mutex_unlock(&(symtab->ctab->lock));
+    return 0;
+  }
+
+  //If the grow fails the table just stays more heavily loaded
+  if((symtab->size + 1) > table->capacity * CTAB_MAX_LOAD &&
+     ctab_grow(symtab, table->capacity * 2) == 0) {
+    table = symtab->ctab->table;
+    index = ctab_probe(table, var, &sym);
+  }
+  //A full table cannot take another Symbol at all
+  if(symtab->size + 1 >= table->capacity ||
+     (sym = symbol_create_pooled(symtab->pool, var, val)) == NULL) {
+    pthread_mutex_unlock(&(symtab->ctab->lock));
+    return -1;
+  }
+
+  __atomic_store_n(&(table->slots[index]), sym, __ATOMIC_RELEASE);
+  __atomic_store_n(&(symtab->size), symtab->size + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&(symtab->ctab->lock));
+  return 0;
+}
+
+/* Grows the table to new_capacity (a power of two) right away.
+ * If new_capacity cannot hold every Symbol, or on any memory errors,
+ *   leave the table as it is.
+ */
+void ctab_rehash(Symtab *symtab, int new_capacity) {
+  pthread_mutex_lock(&(symtab->ctab->lock));
+  ctab_grow(symtab, new_capacity);
+  pthread_mutex_unlock(&(symtab->ctab->lock));
+}
+
+/* Writes every Symbol of the current table to out in slot order.
+ */
+void ctab_write_symtab(Symtab *symtab, Outbuf *out) {
+  Ctab_table *table = __atomic_load_n(&(symtab->ctab->table), __ATOMIC_ACQUIRE);
+  Symbol *sym = NULL;
+  int i = 0;
+
+  for(i = 0; i < table->capacity; i++) {
+    sym = __atomic_load_n(&(table->slots[i]), __ATOMIC_ACQUIRE);
+    if(sym != NULL) {
+      outbuf_write(out, "| ", 2);
+      outbuf_str_pad(out, sym->variable, 10);
+      outbuf_write(out, ": ", 2);
+      outbuf_int(out, ctab_get_value(sym));
+      outbuf_write(out, " \n", 2);
+    }
+  }
+}
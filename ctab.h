@@ -0,0 +1,53 @@
+#ifndef CTAB_H
+#define CTAB_H
+
+#include <pthread.h>
+
+#include "symbol.h"
+#include "outbuf.h"
+
+/* Concurrent Symtab internals.
+ * These work on a Symtab made with hash_initialize_kind(HASH_CONCURRENT);
+ * use the hash_* functions rather than calling them directly.
+ */
+
+#define CTAB_INITIAL 16
+
+/* Keep the table at most half full so probes stay short */
+#define CTAB_MAX_LOAD 0.5
+
+/* Concurrent Table Structure
+ * One generation of the slot array.  slots holds pointers to the Symbols,
+ * probed linearly; an empty slot is NULL.  A table is never changed
+ * once a bigger one replaces it, so a reader still walking it sees a
+ * consistent (if slightly old) set of Symbols.
+ * retired links the tables this one replaced, newest first.
+ */
+typedef struct ctab_table_struct {
+  int capacity;
+  struct ctab_table_struct *retired;
+  Symbol *slots[];
+} Ctab_table;
+
+/* Concurrent Symtab State
+ * table is the current generation.  Readers load it once and probe it
+ * without locking; lock is only taken to add a Symbol or grow the table.
+ * Tables that have been replaced hang off table->retired until the
+ * Symtab is cleared or destroyed, when no reader can still hold them.
+ */
+typedef struct ctab_struct {
+  pthread_mutex_t lock;
+  Ctab_table *table;
+} Ctab;
+
+int ctab_initialize(Symtab *symtab, int capacity);
+void ctab_destroy(Symtab *symtab);
+void ctab_clear(Symtab *symtab);
+int ctab_put(Symtab *symtab, char *var, int val);
+Symbol *ctab_lookup(Symtab *symtab, char *var);
+int ctab_get_value(Symbol *sym);
+void ctab_set_value(Symbol *sym, int val);
+void ctab_rehash(Symtab *symtab, int new_capacity);
+void ctab_write_symtab(Symtab *symtab, Outbuf *out);
+
+#endif
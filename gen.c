@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gen.h"
+#include "token.h"
+
+/* Generator state for one program.
+ * values holds what each variable is worth at this point of the program
+ *   (defined[i] is 0 until variable i is first assigned), so that every
+ *   expression can be checked as it is built.
+ */
+typedef struct gen_struct {
+  Gen_options *opts;
+  FILE *fp;
+  unsigned long long rng;
+  long written;
+  int mix_total;
+  int defined_count;
+  int *defined;
+  long long *values;
+} Gen;
+
+/* Local Function Declarations */
+static unsigned long gen_random(Gen *gen, unsigned long range);
+static void gen_token(Gen *gen, char *text);
+static void gen_value_token(Gen *gen, long long val);
+static long long gen_expr(Gen *gen, int depth);
+static int gen_pick_operator(Gen *gen);
+static long long gen_apply(int oper, long long left, long long right);
+
+/* Fills opts with the defaults: GEN_TOKENS tokens over GEN_VARS variables,
+ *   an even mix of operators and GEN_ASSIGN_PCT assignments.
+ */
+void gen_default_options(Gen_options *opts) {
+  opts->tokens = GEN_TOKENS;
+  opts->vars = GEN_VARS;
+  opts->mix[OPERATOR_PLUS] = 1;
+  opts->mix[OPERATOR_MINUS] = 1;
+  opts->mix[OPERATOR_MULT] = 1;
+  opts->mix[OPERATOR_DIV] = 1;
+  opts->assign_pct = GEN_ASSIGN_PCT;
+  opts->depth = GEN_DEPTH;
+  opts->seed = 1;
+}
+
+/* Sets the operator mix from a string of four weights for + - * and /,
+ *   eg. "4,4,1,1".
+ * Returns 0 on success or -1 if mix is not four non-negative weights with
+ *   at least one above zero.
+ */
+int gen_parse_mix(Gen_options *opts, char *mix) {
+  int weights[4];
+  int i = 0;
+
+  if(mix == NULL || sscanf(mix, "%d,%d,%d,%d", &weights[0], &weights[1],
+                           &weights[2], &weights[3]) != 4) {
+    return -1;
+  }
+  if(weights[0] < 0 || weights[1] < 0 || weights[2] < 0 || weights[3] < 0 ||
+     weights[0] + weights[1] + weights[2] + weights[3] <= 0) {
+    return -1;
+  }
+  for(i = 0; i < 4; i++) {
+    opts->mix[i] = weights[i];
+  }
+  return 0;
+}
+
+/* Sets the option named by flag from value, for command line tools.
+ *   -n tokens, -v vars, -m mix (see gen_parse_mix), -a assign_pct,
+ *   -d depth and -s seed
+ * Returns 0 on success or -1 if flag is unknown or value is bad.
+ */
+int gen_parse_option(Gen_options *opts, char *flag, char *value) {
+  long num = 0;
+
+  if(flag == NULL || value == NULL) {
+    return -1;
+  }
+  if(strcmp(flag, "-m") == 0) {
+    return gen_parse_mix(opts, value);
+  }
+
+  num = atol(value);
+  if(strcmp(flag, "-n") == 0 && num >= 0) {
+    opts->tokens = num;
+  }
+  else if(strcmp(flag, "-v") == 0 && num > 0 && num <= GEN_MAX_VARS) {
+    opts->vars = num;
+  }
+  else if(strcmp(flag, "-a") == 0 && num >= 0 && num <= 100) {
+    opts->assign_pct = num;
+  }
+  else if(strcmp(flag, "-d") == 0 && num >= 0 && num <= GEN_MAX_DEPTH) {
+    opts->depth = num;
+  }
+  else if(strcmp(flag, "-s") == 0) {
+    opts->seed = strtoul(value, NULL, 10);
+  }
+  else {
+    return -1;
+  }
+  return 0;
+}
+
+/* Writes a random, valid RPN program described by opts to fp.
+ * The program is a series of statements, each either an assignment
+ *   (name expression =) or a print (expression print).  Expressions are
+ *   trees of values and already assigned variables, so the program runs
+ *   without errors and leaves the stack empty.
+ * Returns the number of tokens written, or -1 on bad options or memory
+ *   errors.
+ */
+long gen_program(Gen_options *opts, FILE *fp) {
+  Gen gen;
+  char name[MAX_VARIABLE_LEN];
+  int var = 0;
+  long long val = 0;
+
+  if(opts == NULL || fp == NULL || opts->tokens < 0 || opts->vars < 1 ||
+     opts->depth < 0 || opts->assign_pct < 0 || opts->assign_pct > 100) {
+    return -1;
+  }
+
+  gen.opts = opts;
+  gen.fp = fp;
+  //xorshift needs a non-zero state
+  gen.rng = opts->seed * 2654435761ULL + 1;
+  gen.written = 0;
+  gen.mix_total = opts->mix[0] + opts->mix[1] + opts->mix[2] + opts->mix[3];
+  gen.defined_count = 0;
+  gen.defined = calloc(opts->vars, sizeof(int));
+  gen.values = calloc(opts->vars, sizeof(long long));
+  if(gen.mix_total <= 0 || gen.defined == NULL || gen.values == NULL) {
+    free(gen.defined);
+    free(gen.values);
+    return -1;
+  }
+
+  while(gen.written < opts->tokens) {
+    if(gen.defined_count == 0 || gen_random(&gen, 100) < (unsigned long)opts->assign_pct) {
+      var = gen_random(&gen, opts->vars);
+      snprintf(name, sizeof(name), "v%d", var);
+      gen_token(&gen, name);
+      val = gen_expr(&gen, opts->depth);
+      gen_token(&gen, "=");
+      //The variable is only worth val once the = has run
+      if(!gen.defined[var]) {
+        gen.defined[var] = 1;
+        gen.defined_count++;
+      }
+      gen.values[var] = val;
+    }
+    else {
+      gen_expr(&gen, opts->depth);
+      gen_token(&gen, "print");
+    }
+  }
+  if(gen.written % GEN_LINE_TOKENS != 0) {
+    fputc('\n', fp);
+  }
+
+  free(gen.defined);
+  free(gen.values);
+  return gen.written;
+}
+
+/* Local function returning a random number in [0, range) (xorshift64) */
+static unsigned long gen_random(Gen *gen, unsigned long range) {
+  gen->rng ^= gen->rng << 13;
+  gen->rng ^= gen->rng >> 7;
+  gen->rng ^= gen->rng << 17;
+  return (unsigned long)(gen->rng % range);
+}
+
+/* Local function to write one token, GEN_LINE_TOKENS to a line */
+static void gen_token(Gen *gen, char *text) {
+  gen->written++;
+  fputs(text, gen->fp);
+  fputc((gen->written % GEN_LINE_TOKENS == 0) ? '\n' : ' ', gen->fp);
+}
+
+/* Local function to write a value token */
+static void gen_value_token(Gen *gen, long long val) {
+  char text[24];
+
+  snprintf(text, sizeof(text), "%lld", val);
+  gen_token(gen, text);
+}
+
+/* Local function to write an expression tree at most depth deep.
+ * Leaves are assigned variables or small values; returns what the
+ *   expression is worth.
+ */
+static long long gen_expr(Gen *gen, int depth) {
+  char name[MAX_VARIABLE_LEN];
+  long long left = 0;
+  long long right = 0;
+  int oper = 0;
+  int var = 0;
+
+  //A leaf, roughly a third of the time once below the top
+  if(depth == 0 || (depth < gen->opts->depth && gen_random(gen, 3) == 0)) {
+    if(gen->defined_count > 0 && gen_random(gen, 2) == 0) {
+      //Any variable will do if it has been assigned
+      do {
+        var = gen_random(gen, gen->opts->vars);
+      } while(!gen->defined[var]);
+      snprintf(name, sizeof(name), "v%d", var);
+      gen_token(gen, name);
+      return gen->values[var];
+    }
+    left = 1 + gen_random(gen, 99);
+    gen_value_token(gen, left);
+    return left;
+  }
+
+  left = gen_expr(gen, depth - 1);
+  right = gen_expr(gen, depth - 1);
+  oper = gen_pick_operator(gen);
+
+  //Never divide by zero, and keep every value within GEN_VALUE_LIMIT.
+  //With both sides in range one of a + b and a - b always is too.
+  if(oper == OPERATOR_DIV && right == 0) {
+    oper = OPERATOR_PLUS;
+  }
+  if(llabs(gen_apply(oper, left, right)) > GEN_VALUE_LIMIT) {
+    oper = OPERATOR_PLUS;
+    if(llabs(left + right) > GEN_VALUE_LIMIT) {
+      oper = OPERATOR_MINUS;
+    }
+  }
+
+  switch(oper) {
+    case OPERATOR_PLUS: gen_token(gen, "+"); break;
+    case OPERATOR_MINUS: gen_token(gen, "-"); break;
+    case OPERATOR_MULT: gen_token(gen, "*"); break;
+    default: gen_token(gen, "/"); break;
+  }
+  return gen_apply(oper, left, right);
+}
+
+/* Local function to pick an operator by the weights in the mix */
+static int gen_pick_operator(Gen *gen) {
+  int pick = gen_random(gen, gen->mix_total);
+  int oper = 0;
+
+  for(oper = 0; oper < 3; oper++) {
+    if(pick < gen->opts->mix[oper]) {
+      break;
+    }
+    pick -= gen->opts->mix[oper];
+  }
+  return oper;
+}
+
+/* Local function to work out left oper right as rpn would (C division) */
+static long long gen_apply(int oper, long long left, long long right) {
+  switch(oper) {
+    case OPERATOR_PLUS: return left + right;
+    case OPERATOR_MINUS: return left - right;
+    case OPERATOR_MULT: return left * right;
+    default: return left / right;
+  }
+}
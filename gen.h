@@ -0,0 +1,49 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdio.h>
+
+/* Defaults for gen_default_options */
+#define GEN_TOKENS     100000
+#define GEN_VARS       100
+#define GEN_ASSIGN_PCT 50
+#define GEN_DEPTH      3
+
+/* Values in generated programs stay within +/- GEN_VALUE_LIMIT, so no
+ * program ever overflows an int or divides by zero.
+ */
+#define GEN_VALUE_LIMIT 1000000
+
+/* Largest variable count and expression depth gen_parse_option accepts */
+#define GEN_MAX_VARS  1000000
+#define GEN_MAX_DEPTH 16
+
+/* Number of tokens written per line of a generated program */
+#define GEN_LINE_TOKENS 16
+
+/* Generator Options
+ * tokens is the (approximate) number of tokens to generate; the last
+ * -- statement is always finished, so a few more may be written
+ * vars is the number of distinct variables (named v0, v1, ...)
+ * mix holds the relative weights of + - * and / (indexed by OPERATOR_)
+ * assign_pct is the percentage of statements that are assignments
+ * -- (name expression =); the rest are prints (expression print)
+ * depth is the deepest an expression tree gets
+ * seed picks the program; the same options always give the same program
+ */
+typedef struct gen_options_struct {
+  long tokens;
+  int vars;
+  int mix[4];
+  int assign_pct;
+  int depth;
+  unsigned long seed;
+} Gen_options;
+
+/* Generator Function Prototypes */
+void gen_default_options(Gen_options *opts);
+int gen_parse_mix(Gen_options *opts, char *mix);
+int gen_parse_option(Gen_options *opts, char *flag, char *value);
+long gen_program(Gen_options *opts, FILE *fp);
+
+#endif
@@ -2,26 +2,80 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "node.h"
 #include "hash.h"
+#include "oahash.h"
+#include "ctab.h"
+#include "stats.h"
 
-/* Creates a new Symtab struct.
+/* Local Function Declarations */
+static Symbol *hash_lookup_layer(Symtab *symtab, char *var);
+static void hash_migrate(Symtab *symtab, int count);
+
+/* Creates a new Symtab struct using separate chaining.
  * Return the pointer to the new symtab.
  * On any memory errors, return NULL
  */
 Symtab *hash_initialize() {
+  return hash_initialize_kind(HASH_CHAINED);
+}
+
+/* Creates a new Symtab struct of the given kind (HASH_CHAINED, HASH_OPEN or
+ *   HASH_CONCURRENT).
+ * Return the pointer to the new symtab.
+ * On any memory errors or an unknown kind, return NULL
+ */
+Symtab *hash_initialize_kind(int kind) {
   //Initialize Symtab from heap
   Symtab *symtab = malloc(sizeof(Symtab));
   if(symtab == NULL) {
     return NULL;
   }
+  symtab->kind = kind;
+  symtab->table = NULL;
+  symtab->old_table = NULL;
+  symtab->old_capacity = 0;
+  symtab->migrate = 0;
+  symtab->pool = NULL;
+  symtab->slots = NULL;
+  symtab->map = NULL;
+  symtab->map_len = 0;
+  symtab->ctab = NULL;
+  symtab->base = NULL;
+  symtab->shadows = 0;
+
+  if(kind == HASH_OPEN) {
+    if(oahash_initialize(symtab, OAHASH_INITIAL) != 0) {
+      free(symtab);
+      return NULL;
+    }
+    return symtab;
+  }
+  if(kind == HASH_CONCURRENT) {
+    symtab->pool = pool_create(sizeof(Symbol), POOL_SLAB_OBJECTS);
+    if(symtab->pool == NULL || ctab_initialize(symtab, CTAB_INITIAL) != 0) {
+      pool_destroy(symtab->pool);
+      free(symtab);
+      return NULL;
+    }
+    return symtab;
+  }
+  if(kind != HASH_CHAINED) {
+    free(symtab);
+    return NULL;
+  }
+
   //Update Symtab values
   symtab->size = 0;
   symtab->capacity = HASH_TABLE_INITIAL;
   //Initialize Symbol **table from heap
   symtab->table = malloc(sizeof(Symbol *) * HASH_TABLE_INITIAL);
+  //Initialize the pool the Symbols will come from
+  symtab->pool = pool_create(sizeof(Symbol), POOL_SLAB_OBJECTS);
 
-  if(symtab->table == NULL) {
+  if(symtab->table == NULL || symtab->pool == NULL) {
+    free(symtab->table);
+    pool_destroy(symtab->pool);
+    free(symtab);
     return NULL;
   }
   //Initialize all table values to NULL
@@ -32,7 +86,37 @@ Symtab *hash_initialize() {
   return symtab;
 }
 
+/* Creates an empty overlay on top of base: a small HASH_CHAINED Symtab
+ *   that takes every write, while lookups of anything it does not hold
+ *   fall through to base.  Writing a variable of base copies it into the
+ *   overlay first, so base is only ever read and any number of overlays,
+ *   on any number of threads, can share it.  base must outlive them and
+ *   must not change while they use it.
+ * Creating, clearing and destroying an overlay cost the same whatever the
+ *   size of base.  A rehash of a HASH_CHAINED base is finished here, so
+ *   make the first overlay before handing base to other threads.
+ * On any memory errors, or if base is NULL or itself an overlay, return
+ *   NULL
+ */
+Symtab *hash_initialize_overlay(Symtab *base) {
+  Symtab *symtab = NULL;
+
+  if(base == NULL || base->base != NULL) {
+    return NULL;
+  }
+  if(base->kind == HASH_CHAINED) {
+    hash_migrate(base, base->old_capacity);
+  }
+
+  symtab = hash_initialize_kind(HASH_CHAINED);
+  if(symtab != NULL) {
+    symtab->base = base;
+  }
+  return symtab;
+}
+
 /* Destroy your Symbol Table.
+ * The base of an overlay is left alone.
  * Return on any memory errors.
  */
 void hash_destroy(Symtab *symtab) {
@@ -41,28 +125,74 @@ void hash_destroy(Symtab *symtab) {
     return;
   }
 
-  Symbol *temp_symbol = NULL;
-  //Iterate through each index of symtab->table using for loop
-  for (int i = 0; i < symtab->capacity; i++) {
-
-    Symbol *walker = symtab->table[i];
-    //Iterate through each Symbol in the linked list and free them
-    while (walker != NULL) {
-
-      temp_symbol = walker;
-      walker = walker->next;
-      symbol_free(temp_symbol);
-      temp_symbol = NULL;
-    }
+  if(symtab->kind == HASH_OPEN) {
+    oahash_destroy(symtab);
+  }
+  if(symtab->kind == HASH_CONCURRENT) {
+    ctab_destroy(symtab);
   }
-  //free the table and symtab
+
+  //Every Symbol came from the pool, so releasing it frees them all at once
+  STATS_POOL(symtab->pool, "symbol");
+  pool_destroy(symtab->pool);
+  symtab->pool = NULL;
+  //free the tables and symtab
+  free(symtab->old_table);
+  symtab->old_table = NULL;
   free(symtab->table);
   symtab->table = NULL;
   free(symtab);
   symtab = NULL;
 }
 
+/* Removes every Symbol from symtab, keeping its table (and, for
+ *   HASH_CHAINED tables, its pool) so it can be filled again without
+ *   allocating.  Any rehash in progress is dropped along with the Symbols.
+ * An overlay only drops its own Symbols, so it sees just its base again.
+ * If symtab is NULL, return immediately.
+ */
+void hash_clear(Symtab *symtab) {
+  Symbol *walker = NULL;
+  Symbol *next = NULL;
+  int i = 0;
+
+  if(symtab == NULL) {
+    return;
+  }
+  if(symtab->kind == HASH_OPEN) {
+    oahash_clear(symtab);
+    return;
+  }
+  if(symtab->kind == HASH_CONCURRENT) {
+    ctab_clear(symtab);
+    return;
+  }
+
+  //Hand every Symbol back to the pool for the next put to reuse
+  for(i = 0; i < symtab->capacity; i++) {
+    for(walker = symtab->table[i]; walker != NULL; walker = next) {
+      next = walker->next;
+      symbol_free_pooled(symtab->pool, walker);
+    }
+    symtab->table[i] = NULL;
+  }
+  for(i = symtab->migrate; symtab->old_table != NULL && i < symtab->old_capacity; i++) {
+    for(walker = symtab->old_table[i]; walker != NULL; walker = next) {
+      next = walker->next;
+      symbol_free_pooled(symtab->pool, walker);
+    }
+  }
+  free(symtab->old_table);
+  symtab->old_table = NULL;
+  symtab->old_capacity = 0;
+  symtab->migrate = 0;
+  symtab->size = 0;
+  symtab->shadows = 0;
+}
+
 /* Return the capacity of the table inside of symtab.
+ * A HASH_CONCURRENT table may be growing on another thread at the time.
+ * The capacity of an overlay includes its base's.
  * If symtab is NULL, return -1;
  */
 int hash_get_capacity(Symtab *symtab) {
@@ -70,11 +200,16 @@ int hash_get_capacity(Symtab *symtab) {
   if(symtab == NULL) {
     return -1;
   }
+  if(symtab->base != NULL) {
+    return symtab->capacity + hash_get_capacity(symtab->base);
+  }
 
-  return (symtab->capacity);
+  return __atomic_load_n(&(symtab->capacity), __ATOMIC_RELAXED);
 }
 
 /* Return the number of used indexes in the table (size) inside of symtab.
+ * A HASH_CONCURRENT table may be taking new Symbols on another thread.
+ * An overlay counts every variable it can see, its base's included.
  * If symtab is NULL, return -1;
  */
 int hash_get_size(Symtab *symtab) {
@@ -82,12 +217,89 @@ int hash_get_size(Symtab *symtab) {
   if(symtab == NULL) {
     return -1;
   }
+  if(symtab->base != NULL) {
+    return symtab->size + hash_get_size(symtab->base) - symtab->shadows;
+  }
+
+  return __atomic_load_n(&(symtab->size), __ATOMIC_RELAXED);
+}
+
+/* Returns the chain in table that var_hash belongs to */
+static Symbol **hash_chain(Symbol **table, int capacity, long var_hash) {
+  return &(table[var_hash & (capacity - 1)]);
+}
+
+/* Moves up to count chains from the old table (if a rehash is in progress)
+ *   into the current one.  Symbols are relinked, never copied, so pointers
+ *   returned by hash_lookup stay valid.
+ * Once the last old chain has moved, the old table is freed.
+ */
+static void hash_migrate(Symtab *symtab, int count) {
+  Symbol *walker = NULL;
+  Symbol *next = NULL;
+  Symbol **chain = NULL;
+
+  if(symtab->old_table == NULL) {
+    return;
+  }
+  STATS_TIMER(start);
+
+  while(symtab->old_table != NULL && count > 0) {
+    walker = symtab->old_table[symtab->migrate];
+    symtab->old_table[symtab->migrate] = NULL;
+
+    //Push each Symbol of this old chain onto the front of its new chain
+    while(walker != NULL) {
+      next = walker->next;
+      chain = hash_chain(symtab->table, symtab->capacity, hash_code(walker->variable));
+      walker->next = *chain;
+      *chain = walker;
+      walker = next;
+    }
+
+    (symtab->migrate)++;
+    count--;
+
+    if(symtab->migrate == symtab->old_capacity) {
+      free(symtab->old_table);
+      symtab->old_table = NULL;
+      symtab->old_capacity = 0;
+      symtab->migrate = 0;
+    }
+  }
+  STATS_REHASH_TIME(start);
+}
+
+/* Starts moving symtab over to a new, empty table of new_capacity.
+ * Any rehash still in progress is finished first.  The chains then move
+ *   over a few at a time in hash_migrate.
+ * On any memory errors, return -1 and leave the table as it was.
+ */
+static int hash_start_rehash(Symtab *symtab, int new_capacity) {
+  Symbol **new_table = NULL;
+
+  hash_migrate(symtab, symtab->old_capacity);
+
+  //Initialize new_table from heap with new_capacity, with all values set to NULL
+  new_table = calloc(new_capacity, sizeof(Symbol *));
+  if(new_table == NULL) {
+    return -1;
+  }
+  STATS_INC(rehashes);
 
-  return (symtab->size);
+  symtab->old_table = symtab->table;
+  symtab->old_capacity = symtab->capacity;
+  symtab->migrate = 0;
+  symtab->table = new_table;
+  symtab->capacity = new_capacity;
+  return 0;
 }
 
 /* Adds a new Symbol to the symtab via Hashing.
- * If symtab is NULL, there are any malloc errors, or if any rehash fails, return -1;
+ * Each call also moves a few chains along if a rehash is in progress, so
+ *   no single put pays for rebuilding the whole table.
+ * An overlay puts into its own table, never into its base.
+ * If symtab is NULL or there are any malloc errors, return -1;
  * Otherwise, return 0;
  */
 int hash_put(Symtab *symtab, char *var, int val) {
@@ -95,87 +307,184 @@ int hash_put(Symtab *symtab, char *var, int val) {
   if (symtab == NULL) {
       return -1;  
   }
-  //Get the hash value of var in var_hash and calculate respective index
-  long var_hash = hash_code(var);
-  int index = var_hash % (symtab->capacity);
+  STATS_INC(hash_puts);
+  if (symtab->kind == HASH_OPEN) {
+    return oahash_put(symtab, var, val);
+  }
+  if (symtab->kind == HASH_CONCURRENT) {
+    return ctab_put(symtab, var, val);
+  }
 
-  //Create walker for traveral and set it to the index we get
-  Symbol *walker = symtab->table[index];
+  //Checks if the variable already exists (in either table) and if yes it just updates the value and return 0
+  Symbol *walker = hash_lookup_layer(symtab, var);
 
-  //Checks if the variable already exists at that index and if yes it just updates the value and return 0
   if(walker != NULL) {
-    //Traverse through each Symbol in the linked list
-    while(walker != NULL){
-
-      if(!strcmp(walker->variable, var)){
-        walker->val = val;
-        return 0;
-      }
-
-      walker = walker->next;
-    }
+    walker->val = val;
+    return 0;
   }
 
   //In case the variable doesn't exist, create a new symbol and store it in temp_symbol
-  Symbol *temp_symbol = symbol_create(var, val);
+  Symbol *temp_symbol = symbol_create_pooled(symtab->pool, var, val);
 
-  //Check if this new insert made our table load increase more than 2.0 and rehash the table if yes
-  double load = (symtab->size) / (symtab->capacity); 
+  if(temp_symbol == NULL) {
+    return -1;
+  }
 
-  walker = symtab->table[index];
+  //Check if this new insert takes our table load past HASH_MAX_LOAD and rehash the table if yes
+  double load = (double)(symtab->size + 1) / (symtab->capacity);
 
-  //If index is null then directly insert at that index
-  if(walker == NULL){
-    symtab->table[index] = temp_symbol;
-    (symtab->size)++;
-  }
-  else {
-    //Else traverse through the linked list until you find the last item and and insert there
-    while(walker->next != NULL) {
-      walker = walker->next;
-    }
+  //New symbols always go into the current table, at the end of their chain
+  Symbol **chain = hash_chain(symtab->table, symtab->capacity, hash_code(var));
 
-    walker->next = temp_symbol;
-    (symtab->size)++;
+  while(*chain != NULL) {
+    chain = &((*chain)->next);
+    STATS_INC(chain_steps);
+  }
+  *chain = temp_symbol;
+  (symtab->size)++;
+  if(symtab->base != NULL && hash_lookup_layer(symtab->base, var) != NULL) {
+    (symtab->shadows)++;
   }
 
-  if(load >= 2.0) { 
-    hash_rehash(symtab, (symtab->capacity) * 2);
+  //If the rehash cannot start the table just stays more heavily loaded
+  if(load > HASH_MAX_LOAD) {
+    hash_start_rehash(symtab, (symtab->capacity) * 2);
   }
 
   return 0;
 }
 
-/* Gets the Symbol for a variable in the Hash Table.
- * On any NULL symtab or memory errors, return NULL
+/* Finds the Symbol for a variable in the Hash Table without copying it.
+ * The Symbol still belongs to the table: it must not be freed, and it is
+ *   only valid until the next hash_destroy (or, for HASH_OPEN tables, the
+ *   next hash_put or hash_rehash).  The val of a HASH_CONCURRENT Symbol
+ *   may be changed by other threads, and the Symbol an overlay finds may
+ *   belong to its base, so go through hash_get_value and hash_update to
+ *   read and change values.
+ * On any NULL symtab, or if var is not in the table, return NULL
  */
-Symbol *hash_get(Symtab *symtab, char *var) {
+Symbol *hash_lookup(Symtab *symtab, char *var) {
+  Symbol *sym = hash_lookup_layer(symtab, var);
 
-  if(symtab == NULL) {
+  //An overlay falls through to its base for anything it does not hold
+  if(sym == NULL && symtab != NULL && symtab->base != NULL) {
+    sym = hash_lookup_layer(symtab->base, var);
+  }
+  return sym;
+}
+
+/* Local function finding var in the table of symtab itself, never in the
+ *   base of an overlay.
+ */
+static Symbol *hash_lookup_layer(Symtab *symtab, char *var) {
+
+  if(symtab == NULL || var == NULL) {
     return NULL;
   }
-  //Hash var and obtain the index
+  STATS_INC(hash_lookups);
+  if(symtab->kind == HASH_OPEN) {
+    return oahash_lookup(symtab, var);
+  }
+  if(symtab->kind == HASH_CONCURRENT) {
+    return ctab_lookup(symtab, var);
+  }
+
+  hash_migrate(symtab, HASH_MIGRATE_STEP);
+
+  //Hash var and obtain its chain in the current table
   long var_hash = hash_code(var);
-  int index = var_hash % (symtab->capacity);
+  Symbol *walker = *hash_chain(symtab->table, symtab->capacity, var_hash);
 
-  Symbol *walker = symtab->table[index];
-  //Start from that index and traverse the linked list in that index till you find the var or you reach the end
+  //Traverse the chain till you find the var or you reach the end
   while(walker != NULL) {
-  
+    STATS_INC(chain_steps);
     if(!strcmp(walker->variable, var)) {
-      Symbol *temp_symbol = symbol_copy(walker);
-      walker = NULL;
-      return temp_symbol;
+      return walker;
     }
   
     walker = walker->next;
   }
-  //If walker is Null that means nothing exists at that index so return Null
+
+  //While a rehash is in progress var may still be in a chain that has not moved yet
+  if(symtab->old_table != NULL) {
+    walker = *hash_chain(symtab->old_table, symtab->old_capacity, var_hash);
+
+    while(walker != NULL) {
+      STATS_INC(chain_steps);
+      if(!strcmp(walker->variable, var)) {
+        return walker;
+      }
+
+      walker = walker->next;
+    }
+  }
+  //If walker is Null that means var is in neither table so return Null
   return NULL;
 }
 
-/* Doubles the size of the Array in symtab and rehashes.
- * If there were any memory errors, set symtab->array to NULL
+/* Writes the value of a variable into val without allocating.
+ * If symtab is NULL or var is not in the table, return -1 (val is untouched)
+ * Otherwise, return 0
+ */
+int hash_get_value(Symtab *symtab, char *var, int *val) {
+  Symbol *sym = hash_lookup_layer(symtab, var);
+
+  if(sym == NULL && symtab != NULL && symtab->base != NULL) {
+    return hash_get_value(symtab->base, var, val);
+  }
+  if(sym == NULL || val == NULL) {
+    return -1;
+  }
+
+  *val = (symtab->kind == HASH_CONCURRENT) ? ctab_get_value(sym) : sym->val;
+  return 0;
+}
+
+/* Updates the value of a variable that is already in the table, in place.
+ * A variable an overlay only sees in its base is copied into the overlay.
+ * If symtab is NULL or var is not in the table, return -1 (use hash_put)
+ * Otherwise, return 0
+ */
+int hash_update(Symtab *symtab, char *var, int val) {
+  Symbol *sym = hash_lookup_layer(symtab, var);
+
+  if(sym == NULL && symtab != NULL && symtab->base != NULL &&
+     hash_lookup_layer(symtab->base, var) != NULL) {
+    return hash_put(symtab, var, val);
+  }
+  if(sym == NULL) {
+    return -1;
+  }
+
+  if(symtab->kind == HASH_CONCURRENT) {
+    ctab_set_value(sym, val);
+  }
+  else {
+    sym->val = val;
+  }
+  return 0;
+}
+
+/* Gets a copy of the Symbol for a variable in the Hash Table.
+ * The caller must symbol_free the copy.
+ * On any NULL symtab or memory errors, return NULL
+ */
+Symbol *hash_get(Symtab *symtab, char *var) {
+  Symbol *sym = hash_lookup_layer(symtab, var);
+
+  if(sym == NULL && symtab != NULL && symtab->base != NULL) {
+    return hash_get(symtab->base, var);
+  }
+  if(sym != NULL && symtab->kind == HASH_CONCURRENT) {
+    return symbol_create(sym->variable, ctab_get_value(sym));
+  }
+  return symbol_copy(sym);
+}
+
+/* Moves every Symbol in symtab into a table of new_capacity right away.
+ * new_capacity is rounded up to a power of two.
+ * Symbols are relinked into the new table, not reallocated.
+ * If there were any memory errors, the table is left as it was.
  * If symtab is NULL, return immediately.
  */
 void hash_rehash(Symtab *symtab, int new_capacity) {
@@ -183,64 +492,129 @@ void hash_rehash(Symtab *symtab, int new_capacity) {
   if(symtab == NULL) {
     return;
   }
-  //Initialize new_table from heap with new_capacity
-  Symbol **new_table = malloc(sizeof(Symbol *) * new_capacity);
-  
-  if(new_table == NULL) {
-    symtab->table = NULL;
+  new_capacity = hash_round_capacity(new_capacity);
+
+  if(symtab->kind == HASH_OPEN) {
+    oahash_rehash(symtab, new_capacity);
     return;
   }
-  //Set all values in new_table to NULL
-  for (int i = 0; i < new_capacity; i++)
-  {
-    new_table[i] = NULL;
+  if(symtab->kind == HASH_CONCURRENT) {
+    ctab_rehash(symtab, new_capacity);
+    return;
   }
 
-  //Copy the old symtab->table and capacity to temporary variables for future use
-  Symbol **old_table = symtab->table;
-  int old_capacity = symtab->capacity;
+  if(hash_start_rehash(symtab, new_capacity) != 0) {
+    return;
+  }
+  hash_migrate(symtab, symtab->old_capacity);
+}
 
-  //Update the table in symtab to new_table, new_capacity and reset it's size (Basically to use hash_put again recursively and insert all the old symbols from old_table to this symtab with new_table)
-  symtab->capacity = new_capacity;
-  symtab->size = 0;
-  symtab->table = new_table;
+/* Function to print the symbol table 
+ */
+void hash_print_symtab(Symtab *symtab) {
+  Outbuf *out = NULL;
 
-  //Initialize walker and prewalker for traversal
-  Symbol *walker = NULL;
-  Symbol *prewalker = NULL;
+  if(symtab == NULL) {
+    return;
+  }
+  out = outbuf_initialize(OUTBUF_MEMORY);
+  hash_write_symtab(symtab, out);
+  outbuf_print_stdout(out);
+  outbuf_destroy(out);
+}
 
-  //Traverse the old_table and use hash_put to insert these variables and vals to new indexes in the new_table and simultaneously free these symbols after each use
-  for (int i = 0; i < old_capacity; i++) {
+/* Local function to write one symbol table line */
+static void hash_write_symbol(Outbuf *out, Symbol *sym) {
+  outbuf_write(out, "| ", 2);
+  outbuf_str_pad(out, sym->variable, 10);
+  outbuf_write(out, ": ", 2);
+  outbuf_int(out, sym->val);
+  outbuf_write(out, " \n", 2);
+}
 
-    walker = old_table[i];
-    prewalker = old_table[i];
+/* Local function to write a Symbol of an overlay's base as the overlay
+ *   sees it: with the overlay's own value if it has written one.
+ */
+static void hash_write_seen(Symtab *symtab, Symbol *sym, Outbuf *out) {
+  Symbol *own = hash_lookup_layer(symtab, sym->variable);
 
-    while(walker != NULL) {
+  hash_write_symbol(out, (own != NULL) ? own : sym);
+}
 
-      int flag = hash_put(symtab, walker->variable, walker->val);
-      
-      if(flag != 0) {
-        return;
-      }
+/* Local function to write every variable an overlay sees: its base's in
+ *   the base's order, then the ones only the overlay has.  The base's
+ *   rehash, if any, was finished by hash_initialize_overlay.
+ */
+static void hash_write_overlay(Symtab *symtab, Outbuf *out) {
+  Symtab *base = symtab->base;
+  Ctab_table *table = NULL;
+  Symbol *walker = NULL;
+  int i = 0;
 
-      walker = walker->next;
-      symbol_free(prewalker);
-      prewalker = walker; //will become null once walker is null
+  if(base->kind == HASH_OPEN) {
+    for(i = 0; i < base->capacity; i++) {
+      if(base->slots[i].variable[0] != '\0') {
+        hash_write_seen(symtab, &(base->slots[i]), out);
+      }
+    }
+  }
+  else if(base->kind == HASH_CONCURRENT) {
+    table = __atomic_load_n(&(base->ctab->table), __ATOMIC_ACQUIRE);
+    for(i = 0; i < table->capacity; i++) {
+      walker = __atomic_load_n(&(table->slots[i]), __ATOMIC_ACQUIRE);
+      if(walker != NULL) {
+        hash_write_seen(symtab, walker, out);
+      }
+    }
+  }
+  else {
+    for(i = 0; i < base->capacity; i++) {
+      for(walker = base->table[i]; walker != NULL; walker = walker->next) {
+        hash_write_seen(symtab, walker, out);
+      }
     }
   }
 
-  //Free the old table
-  free(old_table);
-  old_table = NULL;
+  for(i = 0; i < symtab->capacity; i++) {
+    for(walker = symtab->table[i]; walker != NULL; walker = walker->next) {
+      if(hash_lookup_layer(base, walker->variable) == NULL) {
+        hash_write_symbol(out, walker);
+      }
+    }
+  }
+  for(i = symtab->migrate; symtab->old_table != NULL && i < symtab->old_capacity; i++) {
+    for(walker = symtab->old_table[i]; walker != NULL; walker = walker->next) {
+      if(hash_lookup_layer(base, walker->variable) == NULL) {
+        hash_write_symbol(out, walker);
+      }
+    }
+  }
 }
 
-/* Function to print the symbol table 
+/* Writes the symbol table to out, in the same form as hash_print_symtab
  */
-void hash_print_symtab(Symtab *symtab) {
+void hash_write_symtab(Symtab *symtab, Outbuf *out) {
   if(symtab == NULL) {
     return;
   }
-  printf("|-----Symbol Table [%d size/%d cap]\n", symtab->size, symtab->capacity);
+  outbuf_str(out, "|-----Symbol Table [");
+  outbuf_int(out, hash_get_size(symtab));
+  outbuf_str(out, " size/");
+  outbuf_int(out, hash_get_capacity(symtab));
+  outbuf_str(out, " cap]\n");
+
+  if(symtab->base != NULL) {
+    hash_write_overlay(symtab, out);
+    return;
+  }
+  if(symtab->kind == HASH_OPEN) {
+    oahash_write_symtab(symtab, out);
+    return;
+  }
+  if(symtab->kind == HASH_CONCURRENT) {
+    ctab_write_symtab(symtab, out);
+    return;
+  }
 
   int i = 0;
   Symbol *walker = NULL;
@@ -250,26 +624,117 @@ void hash_print_symtab(Symtab *symtab) {
     walker = symtab->table[i];
     /* For each found linked list, print every symbol therein */
     while(walker != NULL) {
-      printf("| %10s: %d \n", walker->variable, walker->val);
+      hash_write_symbol(out, walker);
+      walker = walker->next;
+    }
+  }
+  /* Then any chains a rehash in progress has not moved yet */
+  for(i = symtab->migrate; symtab->old_table != NULL && i < symtab->old_capacity; i++) {
+    walker = symtab->old_table[i];
+    while(walker != NULL) {
+      hash_write_symbol(out, walker);
       walker = walker->next;
     }
   }
   return;
 }
 
-/* This computes the hash function for a String
+/* This computes the hash function for a String (32 bit FNV-1a)
+ * Every byte is mixed into all of the bits, so masking off the low bits
+ *   for a power of two table still spreads names evenly.
+ * The result is never negative.
  */
 long hash_code(char *var) {
-  long code = 0;
+  unsigned long code = HASH_FNV_OFFSET;
   int i;
-  int size = strlen(var);
 
-  for(i = 0; i < size; i++) {
-    code = (code + var[i]);
-    if(size == 1 || i < (size - 1)) {
-      code *= 128;
+  for(i = 0; var[i] != '\0'; i++) {
+    code ^= (unsigned char)var[i];
+    code = (code * HASH_FNV_PRIME) & 0xffffffffUL;
+  }
+
+  return (long)code;
+}
+
+/* Returns the smallest power of two that is at least capacity (and at
+ *   least 1).  Tables are always a power of two so indexes can be masked.
+ */
+int hash_round_capacity(int capacity) {
+  int rounded = 1;
+
+  while(rounded < capacity) {
+    rounded *= 2;
+  }
+  return rounded;
+}
+
+/* Adds one chain (or probe) length to a histogram, with the last bucket
+ *   counting everything at or above HASH_HISTOGRAM_LEN - 1.
+ */
+static void hash_histogram_add(long *histogram, int len) {
+  if(len >= HASH_HISTOGRAM_LEN) {
+    len = HASH_HISTOGRAM_LEN - 1;
+  }
+  histogram[len]++;
+}
+
+/* Prints how evenly the symbols are spread over the table to out.
+ * For HASH_CHAINED tables this is a histogram of chain lengths, for
+ *   HASH_OPEN and HASH_CONCURRENT tables a histogram of how many slots each
+ *   symbol sits past the slot it hashes to.  Lookups stay O(1) while these stay short.
+ */
+void hash_print_stats(Symtab *symtab, FILE *out) {
+  long histogram[HASH_HISTOGRAM_LEN] = { 0 };
+  int longest = 0;
+  int len = 0;
+  int i = 0;
+  Symbol *walker = NULL;
+  Ctab_table *table = NULL;
+
+  if(symtab == NULL || out == NULL) {
+    return;
+  }
+
+  if(symtab->kind == HASH_CONCURRENT) {
+    table = __atomic_load_n(&(symtab->ctab->table), __ATOMIC_ACQUIRE);
+    for(i = 0; i < table->capacity; i++) {
+      walker = __atomic_load_n(&(table->slots[i]), __ATOMIC_ACQUIRE);
+      if(walker != NULL) {
+        len = (i - (int)(hash_code(walker->variable) & (table->capacity - 1)) +
+               table->capacity) & (table->capacity - 1);
+        hash_histogram_add(histogram, len);
+        longest = (len > longest) ? len : longest;
+      }
+    }
+  }
+  else if(symtab->kind == HASH_OPEN) {
+    for(i = 0; i < symtab->capacity; i++) {
+      if(symtab->slots[i].variable[0] != '\0') {
+        len = (i - (int)(hash_code(symtab->slots[i].variable) & (symtab->capacity - 1)) +
+               symtab->capacity) & (symtab->capacity - 1);
+        hash_histogram_add(histogram, len);
+        longest = (len > longest) ? len : longest;
+      }
+    }
+  }
+  else {
+    //Finish any rehash so every chain is in the current table
+    hash_migrate(symtab, symtab->old_capacity);
+    for(i = 0; i < symtab->capacity; i++) {
+      len = 0;
+      for(walker = symtab->table[i]; walker != NULL; walker = walker->next) {
+        len++;
+      }
+      hash_histogram_add(histogram, len);
+      longest = (len > longest) ? len : longest;
     }
   }
 
-  return code;
-}
\ No newline at end of file
+  fprintf(out, "%s table: %d symbols, %d capacity, load %.3f, longest %s %d\n",
+          (symtab->kind == HASH_CONCURRENT) ? "concurrent" : (symtab->kind == HASH_OPEN) ? "open" : "chained",
+          symtab->size, symtab->capacity, (double)symtab->size / symtab->capacity,
+          (symtab->kind == HASH_CHAINED) ? "chain" : "probe", longest);
+  for(i = 0; i < HASH_HISTOGRAM_LEN; i++) {
+    fprintf(out, "  %s%2d: %ld\n", (i == HASH_HISTOGRAM_LEN - 1) ? ">=" : "  ", i, histogram[i]);
+  }
+}
@@ -2,18 +2,44 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stdio.h>
+
 #include "symbol.h"
+#include "outbuf.h"
+
+/* Capacities are always a power of two */
+#define HASH_TABLE_INITIAL 8
+
+/* Chained tables rehash once they average more than this many per chain */
+#define HASH_MAX_LOAD 2.0
+
+/* 32 bit FNV-1a constants used by hash_code */
+#define HASH_FNV_OFFSET 2166136261UL
+#define HASH_FNV_PRIME  16777619UL
+
+/* Number of buckets in the hash_print_stats histograms */
+#define HASH_HISTOGRAM_LEN 9
 
-#define HASH_TABLE_INITIAL 5
+/* Number of old chains moved along on each operation during a rehash */
+#define HASH_MIGRATE_STEP 4
 
 Symtab *hash_initialize();
+Symtab *hash_initialize_kind(int kind);
+Symtab *hash_initialize_overlay(Symtab *base);
 void hash_destroy(Symtab *symtab);
+void hash_clear(Symtab *symtab);
 int hash_get_capacity(Symtab *symtab);
 int hash_get_size(Symtab *symtab);
 int hash_put(Symtab *symtab, char *var, int val);
 Symbol *hash_get(Symtab *symtab, char *var);
+Symbol *hash_lookup(Symtab *symtab, char *var);
+int hash_get_value(Symtab *symtab, char *var, int *val);
+int hash_update(Symtab *symtab, char *var, int val);
 void hash_rehash(Symtab *symtab, int new_capacity);
 void hash_print_symtab(Symtab *symtab);
+void hash_write_symtab(Symtab *symtab, Outbuf *out);
 long hash_code(char *var);
+int hash_round_capacity(int capacity);
+void hash_print_stats(Symtab *symtab, FILE *out);
 
 #endif
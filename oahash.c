@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hash.h"
+#include "oahash.h"
+#include "stats.h"
+
+/* Open addressing variant of the symbol table.
+ * Every Symbol is stored inline in one flat array (symtab->slots), so a
+ *   lookup touches the slot it hashes to and, on a collision, the slots
+ *   right after it (linear probing).  No Symbol is ever malloc'd and the
+ *   next pointers are unused.
+ * An empty slot has an empty variable name.  Symbols are never removed,
+ *   so no tombstones are needed.
+ * The slots may be mapped from a snapshot file (see snapshot_load) rather
+ *   than malloc'd; oahash_free_slots releases either.
+ */
+
+/* Releases a slot array of symtab, unmapping it if it came from a snapshot */
+static void oahash_free_slots(Symtab *symtab, Symbol *slots) {
+  if(symtab->map != NULL) {
+    munmap(symtab->map, symtab->map_len);
+    symtab->map = NULL;
+    symtab->map_len = 0;
+    return;
+  }
+  free(slots);
+}
+
+/* Returns the slot var hashes to */
+static int oahash_index(Symtab *symtab, char *var) {
+  return (int)(hash_code(var) & (symtab->capacity - 1));
+}
+
+/* Returns the slot holding var, or the empty slot where it would go */
+static int oahash_probe(Symtab *symtab, char *var) {
+  int index = oahash_index(symtab, var);
+
+  STATS_INC(probe_steps);
+  while(symtab->slots[index].variable[0] != '\0' &&
+        strcmp(symtab->slots[index].variable, var) != 0) {
+    index = (index + 1) & (symtab->capacity - 1);
+    STATS_INC(probe_steps);
+  }
+  return index;
+}
+
+/* Allocates an empty slot array of the given capacity (a power of two)
+ *   into symtab.
+ * On any memory errors, return -1.
+ */
+int oahash_initialize(Symtab *symtab, int capacity) {
+  symtab->slots = calloc(capacity, sizeof(Symbol));
+  if(symtab->slots == NULL) {
+    return -1;
+  }
+
+  symtab->size = 0;
+  symtab->capacity = capacity;
+  return 0;
+}
+
+/* Frees the slot array.  The Symbols live inside it.
+ */
+void oahash_destroy(Symtab *symtab) {
+  oahash_free_slots(symtab, symtab->slots);
+  symtab->slots = NULL;
+}
+
+/* Empties the slot array in place.
+ * Slots mapped from a snapshot are let go of instead (clearing them would
+ *   copy every page), and the table starts again from a fresh
+ *   OAHASH_INITIAL array.
+ */
+void oahash_clear(Symtab *symtab) {
+  Symbol *slots = NULL;
+
+  if(symtab->map != NULL) {
+    slots = calloc(OAHASH_INITIAL, sizeof(Symbol));
+  }
+  if(slots != NULL) {
+    oahash_free_slots(symtab, symtab->slots);
+    symtab->slots = slots;
+    symtab->capacity = OAHASH_INITIAL;
+  }
+  else {
+    memset(symtab->slots, 0, sizeof(Symbol) * symtab->capacity);
+  }
+  symtab->size = 0;
+}
+
+/* Finds the Symbol for var inside the slot array.
+ * Returns NULL if var is not in the table.
+ */
+Symbol *oahash_lookup(Symtab *symtab, char *var) {
+  int index = oahash_probe(symtab, var);
+
+  if(symtab->slots[index].variable[0] == '\0') {
+    return NULL;
+  }
+  return &(symtab->slots[index]);
+}
+
+/* Adds or updates var in the slot array, growing it first if the new
+ *   Symbol would take the table past OAHASH_MAX_LOAD.
+ * If the grow fails, return -1 and leave the table as it was; otherwise
+ *   return 0.
+ */
+int oahash_put(Symtab *symtab, char *var, int val) {
+  int index = oahash_probe(symtab, var);
+  Symbol *slot = &(symtab->slots[index]);
+
+  if(slot->variable[0] != '\0') {
+    slot->val = val;
+    return 0;
+  }
+
+  if((symtab->size + 1) > symtab->capacity * OAHASH_MAX_LOAD) {
+    if(oahash_rehash(symtab, symtab->capacity * 2) != 0) {
+      return -1;
+    }
+    slot = &(symtab->slots[oahash_probe(symtab, var)]);
+  }
+
+  strncpy(slot->variable, var, MAX_VAR_LEN);
+  slot->variable[MAX_VAR_LEN - 1] = '\0';
+  slot->val = val;
+  slot->next = NULL;
+  (symtab->size)++;
+  return 0;
+}
+
+/* Moves every Symbol into a new slot array of new_capacity (a power of two).
+ * Symbols are copied by value; nothing is allocated per Symbol.
+ * If new_capacity cannot hold every Symbol, or there were any memory
+ *   errors, return -1 and leave the table as it was.  Otherwise return 0.
+ */
+int oahash_rehash(Symtab *symtab, int new_capacity) {
+  Symbol *old_slots = symtab->slots;
+  int old_capacity = symtab->capacity;
+  int i = 0;
+
+  if(new_capacity <= symtab->size) {
+    return -1;
+  }
+  STATS_INC(rehashes);
+  STATS_TIMER(start);
+
+  symtab->slots = calloc(new_capacity, sizeof(Symbol));
+  if(symtab->slots == NULL) {
+    symtab->slots = old_slots;
+    return -1;
+  }
+  symtab->capacity = new_capacity;
+
+  for(i = 0; i < old_capacity; i++) {
+    if(old_slots[i].variable[0] != '\0') {
+      symtab->slots[oahash_probe(symtab, old_slots[i].variable)] = old_slots[i];
+    }
+  }
+
+  oahash_free_slots(symtab, old_slots);
+  STATS_REHASH_TIME(start);
+  return 0;
+}
+
+/* Writes every Symbol to out in slot order.
+ */
+void oahash_write_symtab(Symtab *symtab, Outbuf *out) {
+  int i = 0;
+
+  for(i = 0; i < symtab->capacity; i++) {
+    if(symtab->slots[i].variable[0] != '\0') {
+      outbuf_write(out, "| ", 2);
+      outbuf_str_pad(out, symtab->slots[i].variable, 10);
+      outbuf_write(out, ": ", 2);
+      outbuf_int(out, symtab->slots[i].val);
+      outbuf_write(out, " \n", 2);
+    }
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef OAHASH_H
+#define OAHASH_H
+
+#include "symbol.h"
+#include "outbuf.h"
+
+/* Open addressing Symtab internals.
+ * These work on a Symtab made with hash_initialize_kind(HASH_OPEN); use
+ * the hash_* functions rather than calling them directly.
+ */
+
+#define OAHASH_INITIAL 16
+
+/* Keep the table at most half full so probes stay short */
+#define OAHASH_MAX_LOAD 0.5
+
+int oahash_initialize(Symtab *symtab, int capacity);
+void oahash_destroy(Symtab *symtab);
+void oahash_clear(Symtab *symtab);
+int oahash_put(Symtab *symtab, char *var, int val);
+Symbol *oahash_lookup(Symtab *symtab, char *var);
+int oahash_rehash(Symtab *symtab, int new_capacity);
+void oahash_write_symtab(Symtab *symtab, Outbuf *out);
+
+#endif
@@ -0,0 +1,256 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "outbuf.h"
+
+/* Longest decimal int, with its sign */
+#define INT_DIGITS 12
+
+/* Local Function Declarations */
+static int write_all(int fd, struct iovec *iov, int count);
+static int reserve(Outbuf *out, int len);
+static int format_int(char *digits, int val);
+
+/* Creates a new output buffer that flushes to fd.
+ * With fd set to OUTBUF_MEMORY the output is only kept in memory.
+ * Returns NULL on any memory errors.
+ */
+Outbuf *outbuf_initialize(int fd) {
+  Outbuf *out = malloc(sizeof(Outbuf));
+  if(out == NULL) {
+    return NULL;
+  }
+
+  out->fd = fd;
+  out->len = 0;
+  out->error = 0;
+  out->handoff = NULL;
+  out->handoff_arg = NULL;
+  out->capacity = (fd == OUTBUF_MEMORY) ? OUTBUF_MEMORY_INITIAL : OUTBUF_LEN;
+  out->buf = malloc(out->capacity);
+  if(out->buf == NULL) {
+    free(out);
+    return NULL;
+  }
+  return out;
+}
+
+/* Flushes anything left in the buffer, then frees it.
+ */
+void outbuf_destroy(Outbuf *out) {
+  if(out == NULL) {
+    return;
+  }
+  outbuf_flush(out);
+  free(out->buf);
+  free(out);
+}
+
+/* Has an in memory buffer call handoff(arg) each time it fills, before
+ *   it grows.  Once handoff returns an fd rather than OUTBUF_MEMORY, the
+ *   buffer writes to that fd from then on, starting with what it holds.
+ */
+void outbuf_set_handoff(Outbuf *out, int (*handoff)(void *arg), void *arg) {
+  if(out == NULL) {
+    return;
+  }
+  out->handoff = handoff;
+  out->handoff_arg = arg;
+}
+
+/* Local function to write every byte of count iovecs to fd.
+ * Retries short writes and interrupted calls.
+ * Returns 0 on success or -1 once the fd gives an error.
+ */
+static int write_all(int fd, struct iovec *iov, int count) {
+  ssize_t n = 0;
+
+  while(count > 0) {
+    n = writev(fd, iov, count);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    //Step past whatever was written, which may end part way into an iovec
+    while(count > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if(count > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+/* Local function to make room for len more bytes in an in memory buffer.
+ * Returns 0 on success or -1 on memory errors.
+ */
+static int reserve(Outbuf *out, int len) {
+  int capacity = out->capacity;
+  char *buf = NULL;
+
+  while(capacity - out->len < len) {
+    capacity *= 2;
+  }
+  if(capacity == out->capacity) {
+    return 0;
+  }
+  buf = realloc(out->buf, capacity);
+  if(buf == NULL) {
+    return -1;
+  }
+  out->buf = buf;
+  out->capacity = capacity;
+  return 0;
+}
+
+/* Appends len bytes of data.
+ * If they do not fit, the buffer and data go out together in one writev
+ *   (an in memory buffer grows instead, unless its handoff gives it an fd).
+ * Returns 0 on success, -1 on write or memory errors.
+ */
+int outbuf_write(Outbuf *out, const char *data, int len) {
+  struct iovec iov[2];
+
+  if(out == NULL || data == NULL || len < 0) {
+    return -1;
+  }
+  if(out->error) {
+    return -1;
+  }
+
+  if(out->capacity - out->len < len) {
+    if(out->fd == OUTBUF_MEMORY && out->handoff != NULL) {
+      out->fd = out->handoff(out->handoff_arg);
+      if(out->fd != OUTBUF_MEMORY) {
+        out->handoff = NULL;
+      }
+    }
+    if(out->fd == OUTBUF_MEMORY) {
+      if(reserve(out, len) != 0) {
+        out->error = 1;
+        return -1;
+      }
+    }
+    else {
+      iov[0].iov_base = out->buf;
+      iov[0].iov_len = out->len;
+      iov[1].iov_base = (char *)data;
+      iov[1].iov_len = len;
+      out->len = 0;
+      if(write_all(out->fd, iov, 2) != 0) {
+        out->error = 1;
+        return -1;
+      }
+      return 0;
+    }
+  }
+
+  memcpy(out->buf + out->len, data, len);
+  out->len += len;
+  return 0;
+}
+
+/* Appends a NUL terminated string */
+int outbuf_str(Outbuf *out, const char *str) {
+  return outbuf_write(out, str, strlen(str));
+}
+
+/* Appends str right aligned in width characters (like printf's %10s) */
+int outbuf_str_pad(Outbuf *out, const char *str, int width) {
+  int len = strlen(str);
+
+  while(len < width) {
+    if(outbuf_write(out, " ", 1) != 0) {
+      return -1;
+    }
+    width--;
+  }
+  return outbuf_write(out, str, len);
+}
+
+/* Local function to format val in decimal.
+ * The digits are written backwards from the end of digits (INT_DIGITS long),
+ *   and the number of characters used is returned.
+ */
+static int format_int(char *digits, int val) {
+  unsigned int mag = (val < 0) ? 0u - (unsigned int)val : (unsigned int)val;
+  int i = INT_DIGITS;
+
+  //Peel off the digits from the least significant end
+  do {
+    digits[--i] = '0' + mag % 10;
+    mag /= 10;
+  } while(mag != 0);
+
+  if(val < 0) {
+    digits[--i] = '-';
+  }
+  return INT_DIGITS - i;
+}
+
+/* Appends val in decimal (like printf's %d) */
+int outbuf_int(Outbuf *out, int val) {
+  char digits[INT_DIGITS];
+  int len = format_int(digits, val);
+
+  return outbuf_write(out, digits + INT_DIGITS - len, len);
+}
+
+/* Appends val in decimal, right aligned in width characters (like %2d) */
+int outbuf_int_pad(Outbuf *out, int val, int width) {
+  char digits[INT_DIGITS];
+  int len = format_int(digits, val);
+
+  while(len < width) {
+    if(outbuf_write(out, " ", 1) != 0) {
+      return -1;
+    }
+    width--;
+  }
+  return outbuf_write(out, digits + INT_DIGITS - len, len);
+}
+
+/* Writes everything in the buffer to the fd and empties it.
+ * Does nothing for an in memory buffer.
+ * Returns 0 on success or -1 on write errors.
+ */
+int outbuf_flush(Outbuf *out) {
+  struct iovec iov;
+
+  if(out == NULL) {
+    return -1;
+  }
+  if(out->fd == OUTBUF_MEMORY || out->len == 0) {
+    return out->error ? -1 : 0;
+  }
+
+  iov.iov_base = out->buf;
+  iov.iov_len = out->len;
+  out->len = 0;
+  if(write_all(out->fd, &iov, 1) != 0) {
+    out->error = 1;
+  }
+  return out->error ? -1 : 0;
+}
+
+/* Prints the contents of the buffer through stdio's stdout and empties it.
+ * For callers that still mix in printf, so the output stays in order.
+ */
+void outbuf_print_stdout(Outbuf *out) {
+  if(out == NULL) {
+    return;
+  }
+  fwrite(out->buf, 1, out->len, stdout);
+  out->len = 0;
+}
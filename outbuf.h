@@ -0,0 +1,47 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+/* Size of the write buffer; a flush happens each time it fills */
+#define OUTBUF_LEN 65536
+
+/* Pass as the fd to keep all output in memory instead of writing it */
+#define OUTBUF_MEMORY -1
+
+/* Starting size of an in memory buffer, which doubles as it fills */
+#define OUTBUF_MEMORY_INITIAL 4096
+
+/* Output Buffer Structure
+ * Collects program output so it reaches the fd in a few large writes
+ * instead of one stdio call per value.
+ * fd is the file descriptor flushes go to, or OUTBUF_MEMORY
+ * -- In memory mode nothing is ever written; buf just grows to hold it all.
+ * len is the number of bytes waiting in buf
+ * capacity is the number of bytes buf has room for
+ * error is set once a write to fd has failed; later output is dropped
+ * handoff, if set, is asked by an in memory buffer each time it fills
+ * -- whether to stop collecting; see outbuf_set_handoff
+ * Nothing is written until the buffer fills or outbuf_flush is called.
+ */
+typedef struct outbuf_struct {
+  int fd;
+  int len;
+  int capacity;
+  int error;
+  char *buf;
+  int (*handoff)(void *arg);
+  void *handoff_arg;
+} Outbuf;
+
+/* Output Buffer Function Prototypes */
+Outbuf *outbuf_initialize(int fd);
+void outbuf_destroy(Outbuf *out);
+void outbuf_set_handoff(Outbuf *out, int (*handoff)(void *arg), void *arg);
+int outbuf_write(Outbuf *out, const char *data, int len);
+int outbuf_str(Outbuf *out, const char *str);
+int outbuf_str_pad(Outbuf *out, const char *str, int width);
+int outbuf_int(Outbuf *out, int val);
+int outbuf_int_pad(Outbuf *out, int val, int width);
+int outbuf_flush(Outbuf *out);
+void outbuf_print_stdout(Outbuf *out);
+
+#endif
@@ -0,0 +1,584 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "par.h"
+#include "hash.h"
+
+/* A variable reference still on the build stack, resolved by whichever
+ * operation consumes it (see par_resolve) */
+#define PAR_REF 3
+
+/* One worker thread of par_run */
+typedef struct par_worker_struct {
+  Par_run *run;
+  int id;
+} Par_worker;
+
+/* Local Function Declarations */
+static int par_build(Par_run *run);
+static int par_group(Par_run *run, int *parent, int *weight, char *root);
+static int par_link(Par_run *run);
+static Par_operand par_resolve(Par_operand v, int *cur_def);
+static void *par_worker(void *arg);
+static void par_run_task(Par_run *run, int t);
+static int par_value(Par_run *run, Par_operand *v, int *val);
+static void par_push(Par_deque *deque, int t);
+static int par_pop(Par_deque *deque);
+static int par_steal(Par_deque *deque);
+static void par_free(Par_run *run);
+
+/* Runs prog against symtab like program_run, evaluating independent
+ *   subexpressions at the same time on up to threads threads.
+ * The program is rebuilt as a DAG of operations: stack order gives each
+ *   operation its operands, and every read of a variable depends on the
+ *   store it would have seen running in order (the latest one before the
+ *   operation that reads it, as variables are read lazily).  Each store
+ *   makes a new version of its variable, so later stores never wait on
+ *   earlier reads.  Whole subexpressions of PAR_GRAIN or more operations,
+ *   and runs of smaller statements, become tasks that workers take from
+ *   their own deque and steal from each other's.
+ * Print tokens are emitted, and variables written back, only once every
+ *   task is done, in program order and up to the first error exactly as
+ *   program_run would have; so output, symtab and the return value are
+ *   the same.
+ * Programs under PAR_MIN_COUNT instructions, or threads under 2, just use
+ *   program_run.
+ * Returns 0 on success, or -1 on any run or memory errors.
+ */
+int par_run(Program *prog, Symtab *symtab, int threads, void (*emit)(void *arg, int val), void *arg) {
+  Par_run run;
+  Par_worker *workers = NULL;
+  pthread_t *ids = NULL;
+  int *last = NULL;
+  int end = 0;
+  int ret = 0;
+  int started = 0;
+  int i = 0;
+
+  if(prog == NULL || symtab == NULL) {
+    return -1;
+  }
+  if(threads < 2 || prog->count < PAR_MIN_COUNT) {
+    return program_run(prog, symtab, emit, arg);
+  }
+
+  memset(&run, 0, sizeof(run));
+  run.prog = prog;
+  if(par_build(&run) != 0) {
+    par_free(&run);
+    return -1;
+  }
+
+  //Variables the program does not assign keep their values from symtab
+  for(i = 0; i < prog->slot_count; i++) {
+    run.defined[i] = (hash_get_value(symtab, prog->names[i], &run.init[i]) == 0);
+  }
+
+  run.worker_count = (threads > PAR_MAX_THREADS) ? PAR_MAX_THREADS : threads;
+  run.worker_count = (run.worker_count > run.task_count) ? run.task_count : run.worker_count;
+  run.worker_count = (run.worker_count < 1) ? 1 : run.worker_count;
+  run.deques = calloc(run.worker_count, sizeof(Par_deque));
+  workers = malloc(sizeof(Par_worker) * run.worker_count);
+  ids = malloc(sizeof(pthread_t) * run.worker_count);
+  last = malloc(sizeof(int) * (prog->slot_count + 1));
+  if(run.deques == NULL || workers == NULL || ids == NULL || last == NULL) {
+    free(run.deques);
+    run.deques = NULL;
+    free(workers);
+    free(ids);
+    free(last);
+    par_free(&run);
+    return -1;
+  }
+  for(i = 0; i < run.worker_count; i++) {
+    run.deques[i].tasks = malloc(sizeof(int) * (run.task_count + 1));
+    run.deques[i].head = 0;
+    run.deques[i].tail = 0;
+    pthread_mutex_init(&run.deques[i].lock, NULL);
+    workers[i].run = &run;
+    workers[i].id = i;
+    if(run.deques[i].tasks == NULL) {
+      ret = -1;
+    }
+  }
+
+  if(ret == 0) {
+    //Deal the tasks that wait on nothing out to the workers
+    for(i = 0; i < run.task_count; i++) {
+      if(run.pending[i] == 0) {
+        par_push(&run.deques[started++ % run.worker_count], i);
+      }
+    }
+
+    //This thread is worker 0; if a thread cannot start its deque is stolen
+    for(i = 1; i < run.worker_count; i++) {
+      if(pthread_create(&ids[i], NULL, par_worker, &workers[i]) != 0) {
+        break;
+      }
+    }
+    started = i;
+    par_worker(&workers[0]);
+    for(i = 1; i < started; i++) {
+      pthread_join(ids[i], NULL);
+    }
+
+    //Everything before the first error happened; nothing after it did
+    end = run.error;
+    for(i = 0; i < run.node_count && run.pc[i] < end; i++) {
+      if(run.failed[i]) {
+        end = run.pc[i];
+      }
+    }
+    for(i = 0; i < prog->slot_count; i++) {
+      last[i] = -1;
+    }
+    for(i = 0; i < run.node_count && run.pc[i] < end; i++) {
+      if(run.op[i] == OP_PRINT && emit != NULL) {
+        emit(arg, run.val[i]);
+      }
+      else if(run.op[i] == OP_STORE) {
+        last[run.b[i].val] = i;
+      }
+    }
+    ret = (end < prog->count) ? -1 : 0;
+
+    //Write every variable the program assigned back to symtab
+    for(i = 0; i < prog->slot_count; i++) {
+      if(last[i] >= 0 && hash_update(symtab, prog->names[i], run.val[last[i]]) != 0 &&
+         hash_put(symtab, prog->names[i], run.val[last[i]]) != 0) {
+        ret = -1;
+      }
+    }
+  }
+
+  for(i = 0; i < run.worker_count; i++) {
+    pthread_mutex_destroy(&run.deques[i].lock);
+    free(run.deques[i].tasks);
+  }
+  free(run.deques);
+  run.deques = NULL;
+  free(workers);
+  free(ids);
+  free(last);
+  par_free(&run);
+  return ret;
+}
+
+/* Local function to rebuild run->prog as a DAG of nodes and split it into
+ *   tasks (see par_group and par_link).
+ * Building stops at the first instruction that can never run.
+ * Returns 0 on success, or -1 on any memory errors.
+ */
+static int par_build(Par_run *run) {
+  Program *prog = run->prog;
+  Instr *code = prog->code;
+  Par_operand *stack = NULL;
+  Par_operand top;
+  int *cur_def = NULL;
+  int *parent = NULL;
+  int *weight = NULL;
+  char *root = NULL;
+  int count = prog->count;
+  int sp = 0;
+  int n = 0;
+  int i = 0;
+  int k = 0;
+  int ret = 0;
+
+  run->pc = malloc(sizeof(int) * (count + 1));
+  run->op = malloc(sizeof(int) * (count + 1));
+  run->a = malloc(sizeof(Par_operand) * (count + 1));
+  run->b = malloc(sizeof(Par_operand) * (count + 1));
+  run->val = malloc(sizeof(int) * (count + 1));
+  run->failed = calloc(count + 1, sizeof(char));
+  run->init = malloc(sizeof(int) * (prog->slot_count + 1));
+  run->defined = calloc(prog->slot_count + 1, sizeof(char));
+  stack = malloc(sizeof(Par_operand) * (prog->max_depth + 1));
+  cur_def = malloc(sizeof(int) * (prog->slot_count + 1));
+  parent = malloc(sizeof(int) * (count + 1));
+  weight = malloc(sizeof(int) * (count + 1));
+  root = calloc(count + 1, sizeof(char));
+  if(run->pc == NULL || run->op == NULL || run->a == NULL || run->b == NULL ||
+     run->val == NULL || run->failed == NULL || run->init == NULL || run->defined == NULL ||
+     stack == NULL || cur_def == NULL || parent == NULL || weight == NULL || root == NULL) {
+    ret = -1;
+  }
+  for(i = 0; ret == 0 && i < prog->slot_count; i++) {
+    cur_def[i] = -1;
+  }
+
+  //Replay the stack, turning every instruction that uses it into a node
+  run->error = count;
+  for(i = 0; ret == 0 && i < count; i++) {
+    if(code[i].op == OP_PUSH || code[i].op == OP_LOAD) {
+      if(sp > prog->max_depth) {
+        run->error = i;
+        break;
+      }
+      stack[sp].kind = (code[i].op == OP_PUSH) ? PAR_CONST : PAR_REF;
+      stack[sp].val = code[i].arg;
+      sp++;
+      continue;
+    }
+    if(code[i].op < OP_STORE || code[i].op > OP_PRINT ||
+       sp < ((code[i].op == OP_PRINT) ? 1 : 2) ||
+       (code[i].op == OP_STORE && stack[sp - 2].kind != PAR_REF)) {
+      run->error = i;
+      break;
+    }
+
+    run->pc[n] = i;
+    run->op[n] = code[i].op;
+    parent[n] = -1;
+    weight[n] = 1;
+    top = stack[sp - 1];
+    run->a[n] = par_resolve(top, cur_def);
+    run->b[n].kind = PAR_CONST;
+    run->b[n].val = 0;
+
+    //Results of operations are used once, by the node that pops them
+    for(k = 0; k < ((code[i].op >= OP_ADD && code[i].op <= OP_DIV) ? 2 : 1); k++) {
+      top = stack[sp - 1 - k];
+      if(k == 1) {
+        run->b[n] = par_resolve(top, cur_def);
+      }
+      if(top.kind == PAR_NODE) {
+        parent[top.val] = n;
+        if(weight[top.val] >= PAR_GRAIN) {
+          root[top.val] = 1;
+        }
+        else {
+          weight[n] += weight[top.val];
+        }
+      }
+    }
+
+    if(code[i].op == OP_STORE) {
+      run->b[n].val = stack[sp - 2].val;
+      cur_def[stack[sp - 2].val] = n;
+      sp -= 2;
+    }
+    else if(code[i].op == OP_PRINT) {
+      sp--;
+    }
+    else {
+      sp--;
+      stack[sp - 1].kind = PAR_NODE;
+      stack[sp - 1].val = n;
+    }
+    n++;
+  }
+  run->node_count = n;
+
+  if(ret == 0) {
+    ret = par_group(run, parent, weight, root);
+  }
+  if(ret == 0) {
+    ret = par_link(run);
+  }
+  free(stack);
+  free(cur_def);
+  free(parent);
+  free(weight);
+  free(root);
+  return ret;
+}
+
+/* Local function to put every node in a task.
+ * A node with nothing using its result, or whose subexpression reached
+ *   PAR_GRAIN, roots a tree of the nodes under it.  Trees are gathered
+ *   into tasks in program order until each task has PAR_GRAIN nodes, so
+ *   every dependency between tasks runs from an earlier task to a later
+ *   one and the task graph has no cycles.
+ * Returns 0 on success, or -1 on any memory errors.
+ */
+static int par_group(Par_run *run, int *parent, int *weight, char *root) {
+  int *owner = NULL;
+  int *fill = NULL;
+  int group = 0;
+  int n = 0;
+
+  run->task = malloc(sizeof(int) * (run->node_count + 1));
+  owner = malloc(sizeof(int) * (run->node_count + 1));
+  if(run->task == NULL || owner == NULL) {
+    free(owner);
+    return -1;
+  }
+
+  //Find the root of every node's tree (roots come after their nodes)
+  for(n = run->node_count - 1; n >= 0; n--) {
+    owner[n] = (root[n] || parent[n] < 0) ? n : owner[parent[n]];
+  }
+
+  //Gather trees into tasks, in the order of their roots
+  run->task_count = 0;
+  for(n = 0; n < run->node_count; n++) {
+    if(owner[n] == n) {
+      run->task[n] = run->task_count;
+      group += weight[n];
+      if(group >= PAR_GRAIN) {
+        run->task_count++;
+        group = 0;
+      }
+    }
+  }
+  if(group > 0) {
+    run->task_count++;
+  }
+  for(n = 0; n < run->node_count; n++) {
+    run->task[n] = run->task[owner[n]];
+  }
+  free(owner);
+
+  //List each task's nodes together, still in program order
+  run->task_start = calloc(run->task_count + 1, sizeof(int));
+  run->task_nodes = malloc(sizeof(int) * (run->node_count + 1));
+  fill = malloc(sizeof(int) * (run->task_count + 1));
+  if(run->task_start == NULL || run->task_nodes == NULL || fill == NULL) {
+    free(fill);
+    return -1;
+  }
+  for(n = 0; n < run->node_count; n++) {
+    run->task_start[run->task[n] + 1]++;
+  }
+  for(n = 0; n < run->task_count; n++) {
+    run->task_start[n + 1] += run->task_start[n];
+    fill[n] = run->task_start[n];
+  }
+  for(n = 0; n < run->node_count; n++) {
+    run->task_nodes[fill[run->task[n]]++] = n;
+  }
+  free(fill);
+  return 0;
+}
+
+/* Local function to record which tasks wait on which.
+ * A task waits once for every operand of its nodes that another task
+ *   computes.
+ * Returns 0 on success, or -1 on any memory errors.
+ */
+static int par_link(Par_run *run) {
+  Par_operand *v = NULL;
+  int *fill = NULL;
+  int edges = 0;
+  int pass = 0;
+  int n = 0;
+  int k = 0;
+
+  run->pending = calloc(run->task_count + 1, sizeof(int));
+  run->succ_start = calloc(run->task_count + 1, sizeof(int));
+  fill = malloc(sizeof(int) * (run->task_count + 1));
+  if(run->pending == NULL || run->succ_start == NULL || fill == NULL) {
+    free(fill);
+    return -1;
+  }
+
+  //Count the edges out of each task, then fill them in
+  for(pass = 0; pass < 2; pass++) {
+    for(n = 0; n < run->node_count; n++) {
+      for(k = 0; k < 2; k++) {
+        v = (k == 0) ? &run->a[n] : &run->b[n];
+        if(v->kind != PAR_NODE || run->task[v->val] == run->task[n] ||
+           (k == 1 && run->op[n] == OP_STORE)) {
+          continue;
+        }
+        if(pass == 0) {
+          run->succ_start[run->task[v->val] + 1]++;
+          run->pending[run->task[n]]++;
+          edges++;
+        }
+        else {
+          run->succ[fill[run->task[v->val]]++] = run->task[n];
+        }
+      }
+    }
+    if(pass == 0) {
+      for(n = 0; n < run->task_count; n++) {
+        run->succ_start[n + 1] += run->succ_start[n];
+        fill[n] = run->succ_start[n];
+      }
+      run->succ = malloc(sizeof(int) * (edges + 1));
+      if(run->succ == NULL) {
+        free(fill);
+        return -1;
+      }
+    }
+  }
+  free(fill);
+  return 0;
+}
+
+/* Local function to turn a build stack entry into the operand of the node
+ *   consuming it.  A variable reference reads the latest store to it so
+ *   far, or its value from before the program if there is none.
+ */
+static Par_operand par_resolve(Par_operand v, int *cur_def) {
+  if(v.kind == PAR_REF) {
+    if(cur_def[v.val] >= 0) {
+      v.kind = PAR_NODE;
+      v.val = cur_def[v.val];
+    }
+    else {
+      v.kind = PAR_SLOT;
+    }
+  }
+  return v;
+}
+
+/* Local function run by each worker: runs tasks from its own deque, or
+ *   stolen from the others, until every task is done.
+ */
+static void *par_worker(void *arg) {
+  Par_worker *worker = arg;
+  Par_run *run = worker->run;
+  int t = 0;
+  int s = 0;
+  int i = 0;
+
+  while(__atomic_load_n(&run->done, __ATOMIC_ACQUIRE) < run->task_count) {
+    t = par_pop(&run->deques[worker->id]);
+    for(i = 1; t < 0 && i < run->worker_count; i++) {
+      t = par_steal(&run->deques[(worker->id + i) % run->worker_count]);
+    }
+    if(t < 0) {
+      sched_yield();
+      continue;
+    }
+
+    par_run_task(run, t);
+    //Whoever finishes a task's last input runs it next, while it is hot
+    for(i = run->succ_start[t]; i < run->succ_start[t + 1]; i++) {
+      s = run->succ[i];
+      if(__atomic_sub_fetch(&run->pending[s], 1, __ATOMIC_ACQ_REL) == 0) {
+        par_push(&run->deques[worker->id], s);
+      }
+    }
+    __atomic_add_fetch(&run->done, 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/* Local function to run the nodes of task t in program order.
+ * A node fails if it divides by zero, reads a variable that has no value,
+ *   or uses the result of a node that failed.
+ */
+static void par_run_task(Par_run *run, int t) {
+  int a = 0, b = 0;
+  int fail = 0;
+  int n = 0;
+  int i = 0;
+
+  for(i = run->task_start[t]; i < run->task_start[t + 1]; i++) {
+    n = run->task_nodes[i];
+    fail = par_value(run, &run->a[n], &a);
+
+    switch(run->op[n]) {
+    case OP_STORE:
+    case OP_PRINT:
+      run->val[n] = a;
+      break;
+
+    default:
+      fail = fail || par_value(run, &run->b[n], &b);
+      if(fail) {
+        break;
+      }
+      if(run->op[n] == OP_ADD) {
+        run->val[n] = b + a;
+      }
+      else if(run->op[n] == OP_SUB) {
+        run->val[n] = b - a;
+      }
+      else if(run->op[n] == OP_MUL) {
+        run->val[n] = b * a;
+      }
+      else if(a != 0) {
+        run->val[n] = b / a;
+      }
+      else {
+        fail = 1;
+      }
+      break;
+    }
+    run->failed[n] = fail;
+  }
+}
+
+/* Local function to get the value of an operand into val.
+ * Returns 0, or -1 if it has no value.
+ */
+static int par_value(Par_run *run, Par_operand *v, int *val) {
+  if(v->kind == PAR_CONST) {
+    *val = v->val;
+    return 0;
+  }
+  if(v->kind == PAR_SLOT) {
+    if(!run->defined[v->val]) {
+      return -1;
+    }
+    *val = run->init[v->val];
+    return 0;
+  }
+  if(run->failed[v->val]) {
+    return -1;
+  }
+  *val = run->val[v->val];
+  return 0;
+}
+
+/* Local function to add a ready task to the tail of a deque */
+static void par_push(Par_deque *deque, int t) {
+  pthread_mutex_lock(&deque->lock);
+  deque->tasks[deque->tail++] = t;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+/* Local function to take the newest task from the tail of a deque.
+ * Returns -1 if it is empty.
+ */
+static int par_pop(Par_deque *deque) {
+  int t = -1;
+
+  pthread_mutex_lock(&deque->lock);
+  if(deque->tail > deque->head) {
+    t = deque->tasks[--deque->tail];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return t;
+}
+
+/* Local function to steal the oldest task from the head of a deque.
+ * Returns -1 if it is empty.
+ */
+static int par_steal(Par_deque *deque) {
+  int t = -1;
+
+  pthread_mutex_lock(&deque->lock);
+  if(deque->tail > deque->head) {
+    t = deque->tasks[deque->head++];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return t;
+}
+
+/* Local function to free everything par_build made */
+static void par_free(Par_run *run) {
+  free(run->pc);
+  free(run->op);
+  free(run->a);
+  free(run->b);
+  free(run->val);
+  free(run->failed);
+  free(run->init);
+  free(run->defined);
+  free(run->task);
+  free(run->task_start);
+  free(run->task_nodes);
+  free(run->pending);
+  free(run->succ_start);
+  free(run->succ);
+}
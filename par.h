@@ -0,0 +1,85 @@
+#ifndef PAR_H
+#define PAR_H
+
+#include <pthread.h>
+
+#include "program.h"
+
+/* Programs shorter than this many instructions always run sequentially */
+#define PAR_MIN_COUNT 16384
+
+/* Subexpressions of at least this many operations become tasks of their own */
+#define PAR_GRAIN 1024
+
+/* Most threads par_run will use */
+#define PAR_MAX_THREADS 256
+
+/* Kinds of Par_operand */
+#define PAR_CONST 0
+#define PAR_SLOT  1
+#define PAR_NODE  2
+
+/* Parallel Operand Structure
+ * Where an operation gets one of its inputs from: the constant val
+ * (PAR_CONST), the value slot val had before the program started
+ * (PAR_SLOT), or the result of node val (PAR_NODE).
+ */
+typedef struct par_operand_struct {
+  int kind;
+  int val;
+} Par_operand;
+
+/* Task Deque Structure
+ * The ready tasks of one worker.  The worker pushes and pops at tail;
+ * other workers steal the oldest task from head.  lock guards all three.
+ */
+typedef struct par_deque_struct {
+  int *tasks;
+  int head;
+  int tail;
+  pthread_mutex_t lock;
+} Par_deque;
+
+/* Parallel Run Structure
+ * A Program rebuilt as a DAG.  Every operation, store and print is a node
+ * (pushes and loads become the operands of the node that uses them);
+ * nodes are numbered in program order and pc maps them back to the code.
+ * op, a and b are each node's opcode and operands; stores keep their
+ * -- value in a and their variable slot in b
+ * val and failed hold each node's result once it has run
+ * task is the task each node belongs to; task_nodes lists the nodes of
+ * -- task t (in program order) from task_start[t] to task_start[t + 1]
+ * pending counts the tasks each task still waits for, and succ lists the
+ * -- tasks waiting on task t from succ_start[t] to succ_start[t + 1]
+ * error is the pc of the first instruction that cannot run at all
+ * -- (a stack underflow or a store to a non variable), or count if none
+ * init and defined are the slots' values before the program started
+ */
+typedef struct par_run_struct {
+  Program *prog;
+  int node_count;
+  int *pc;
+  int *op;
+  Par_operand *a;
+  Par_operand *b;
+  int *val;
+  char *failed;
+  int task_count;
+  int *task;
+  int *task_start;
+  int *task_nodes;
+  int *pending;
+  int *succ_start;
+  int *succ;
+  int error;
+  int *init;
+  char *defined;
+  int done;
+  int worker_count;
+  Par_deque *deques;
+} Par_run;
+
+/* Parallel Function Prototypes */
+int par_run(Program *prog, Symtab *symtab, int threads, void (*emit)(void *arg, int val), void *arg);
+
+#endif
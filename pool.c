@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/* Objects and the slab header are padded to this alignment */
+#define POOL_ALIGN 16
+
+/* Rounds size up to a multiple of POOL_ALIGN */
+static size_t pool_round(size_t size) {
+  return (size + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+}
+
+/* Creates a new Pool for objects of obj_size bytes, allocating per_slab
+ *   objects at a time.
+ * Returns NULL on any memory errors.
+ */
+Pool *pool_create(size_t obj_size, int per_slab) {
+  Pool *pool = malloc(sizeof(Pool));
+  if(pool == NULL) {
+    return NULL;
+  }
+
+  //Freed objects hold the free list link, so they must fit a pointer
+  if(obj_size < sizeof(void *)) {
+    obj_size = sizeof(void *);
+  }
+  pool->obj_size = pool_round(obj_size);
+  pool->per_slab = (per_slab > 0) ? per_slab : POOL_SLAB_OBJECTS;
+  pool->free_list = NULL;
+  pool->slabs = NULL;
+  pool->next = NULL;
+  pool->left = 0;
+  pool->allocs = 0;
+  pool->frees = 0;
+  pool->slab_count = 0;
+  return pool;
+}
+
+/* Releases every slab, and with them every object, in one go.
+ */
+void pool_destroy(Pool *pool) {
+  Pool_slab *slab = NULL;
+
+  if(pool == NULL) {
+    return;
+  }
+
+  while(pool->slabs != NULL) {
+    slab = pool->slabs;
+    pool->slabs = slab->next;
+    free(slab);
+  }
+  free(pool);
+}
+
+/* Hands out one object, reusing a freed one if there is any.
+ * Returns NULL on any memory errors.
+ */
+void *pool_alloc(Pool *pool) {
+  void *obj = NULL;
+  Pool_slab *slab = NULL;
+
+  if(pool == NULL) {
+    return NULL;
+  }
+
+  //Reuse the most recently freed object first
+  if(pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = *(void **)obj;
+    pool->allocs++;
+    return obj;
+  }
+
+  //Otherwise carve one out of the current slab, starting a new one if needed
+  if(pool->left == 0) {
+    slab = malloc(pool_round(sizeof(Pool_slab)) + pool->obj_size * pool->per_slab);
+    if(slab == NULL) {
+      return NULL;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->next = (char *)slab + pool_round(sizeof(Pool_slab));
+    pool->left = pool->per_slab;
+    pool->slab_count++;
+  }
+
+  obj = pool->next;
+  pool->next += pool->obj_size;
+  pool->left--;
+  pool->allocs++;
+  return obj;
+}
+
+/* Returns an object to the pool's free list.
+ */
+void pool_free(Pool *pool, void *obj) {
+  if(pool == NULL || obj == NULL) {
+    return;
+  }
+
+  *(void **)obj = pool->free_list;
+  pool->free_list = obj;
+  pool->frees++;
+}
+
+/* Returns how many mallocs the pool has avoided so far.
+ */
+long pool_avoided(Pool *pool) {
+  if(pool == NULL) {
+    return 0;
+  }
+
+  return (pool->allocs - pool->slab_count);
+}
+
+/* Prints the pool counters to stderr.
+ */
+void pool_print_stats(Pool *pool, char *name) {
+  if(pool == NULL) {
+    return;
+  }
+
+  fprintf(stderr, "%s pool: %ld allocs, %ld frees, %ld slab mallocs, %ld mallocs avoided\n",
+          name, pool->allocs, pool->frees, pool->slab_count, pool_avoided(pool));
+}
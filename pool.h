@@ -0,0 +1,43 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define POOL_SLAB_OBJECTS 64
+
+/* Slab Structure
+ * One malloc'd block of objects.  The objects follow the header.
+ */
+typedef struct pool_slab_struct {
+  struct pool_slab_struct *next;
+} Pool_slab;
+
+/* Pool Structure
+ * A free-list allocator for objects of a single fixed size.
+ * Objects are carved out of slabs of per_slab objects; freed objects go on
+ * free_list and are handed out again before any new slab is malloc'd.
+ * Destroying the pool releases every slab in one go.
+ * allocs, frees and slab_count count pool_alloc calls, pool_free calls
+ * and slab mallocs, so allocs - slab_count mallocs have been avoided.
+ */
+typedef struct pool_struct {
+  size_t obj_size;
+  int per_slab;
+  void *free_list;
+  Pool_slab *slabs;
+  char *next;
+  int left;
+  long allocs;
+  long frees;
+  long slab_count;
+} Pool;
+
+/* Pool Function Prototypes */
+Pool *pool_create(size_t obj_size, int per_slab);
+void pool_destroy(Pool *pool);
+void *pool_alloc(Pool *pool);
+void pool_free(Pool *pool, void *obj);
+long pool_avoided(Pool *pool);
+void pool_print_stats(Pool *pool, char *name);
+
+#endif
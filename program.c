@@ -0,0 +1,599 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "hash.h"
+#include "program.h"
+#include "stats.h"
+
+/* A value on the executor's stack.
+ * slot is the variable slot it refers to, or -1 for a plain value in val.
+ */
+typedef struct run_value_struct {
+  int slot;
+  int val;
+} Run_value;
+
+/* Creates a new, empty Program on the Heap.
+ * Returns NULL on any memory errors.
+ */
+Program *program_initialize() {
+  Program *prog = malloc(sizeof(Program));
+  if(prog == NULL) {
+    return NULL;
+  }
+
+  prog->count = 0;
+  prog->capacity = PROGRAM_INITIAL;
+  prog->code = malloc(sizeof(Instr) * PROGRAM_INITIAL);
+  prog->slot_count = 0;
+  prog->slot_capacity = PROGRAM_INITIAL;
+  prog->names = malloc(sizeof(*prog->names) * PROGRAM_INITIAL);
+  prog->slots = hash_initialize_kind(HASH_OPEN);
+  prog->depth = 0;
+  prog->max_depth = 0;
+
+  if(prog->code == NULL || prog->names == NULL || prog->slots == NULL) {
+    program_destroy(prog);
+    return NULL;
+  }
+  return prog;
+}
+
+/* Destroys a Program.
+ */
+void program_destroy(Program *prog) {
+  if(prog == NULL) {
+    return;
+  }
+
+  free(prog->code);
+  free(prog->names);
+  hash_destroy(prog->slots);
+  free(prog);
+}
+
+/* Appends one instruction, tracking how deep it leaves the stack.
+ * depth is how much the instruction changes the stack depth by.
+ * On any memory errors, return -1.
+ */
+static int program_emit(Program *prog, int op, int arg, int depth) {
+  Instr *code = NULL;
+
+  if(prog->count == prog->capacity) {
+    code = realloc(prog->code, sizeof(Instr) * prog->capacity * 2);
+    if(code == NULL) {
+      return -1;
+    }
+    prog->code = code;
+    prog->capacity *= 2;
+  }
+
+  prog->code[prog->count].op = op;
+  prog->code[prog->count].arg = arg;
+  prog->count++;
+
+  //An underflow is reported when the program runs, so just stop at 0 here
+  prog->depth += depth;
+  if(prog->depth < 0) {
+    prog->depth = 0;
+  }
+  if(prog->depth > prog->max_depth) {
+    prog->max_depth = prog->depth;
+  }
+  return 0;
+}
+
+/* Returns the slot for a variable name, interning it if it is new.
+ * On any memory errors, return -1.
+ */
+static int program_slot(Program *prog, char *name) {
+  char (*names)[MAX_VAR_LEN] = NULL;
+  int slot = -1;
+  int len = 0;
+
+  if(hash_get_value(prog->slots, name, &slot) == 0) {
+    return slot;
+  }
+
+  if(prog->slot_count == prog->slot_capacity) {
+    names = realloc(prog->names, sizeof(*prog->names) * prog->slot_capacity * 2);
+    if(names == NULL) {
+      return -1;
+    }
+    prog->names = names;
+    prog->slot_capacity *= 2;
+  }
+
+  slot = prog->slot_count;
+  if(hash_put(prog->slots, name, slot) != 0) {
+    return -1;
+  }
+  //Names are at most MAX_VAR_LEN - 1 long, as in the symbol table
+  len = strlen(name);
+  if(len > MAX_VAR_LEN - 1) {
+    len = MAX_VAR_LEN - 1;
+  }
+  memcpy(prog->names[slot], name, len);
+  prog->names[slot][len] = '\0';
+  prog->slot_count++;
+  return slot;
+}
+
+/* Compiles every token remaining in ctx onto the end of prog.
+ * Call it once per chunk to compile a program of any size.
+ * On any memory errors or unknown tokens, return -1.
+ */
+int program_compile(Program *prog, Token_ctx *ctx) {
+  Token tok;
+  int slot = -1;
+  int flag = 0;
+
+  if(prog == NULL || ctx == NULL) {
+    return -1;
+  }
+
+  while(flag == 0 && token_ctx_next(ctx, &tok) == 0) {
+    switch(tok.type) {
+
+    case TYPE_VALUE:
+      flag = program_emit(prog, OP_PUSH, tok.value, 1);
+      break;
+
+    case TYPE_VARIABLE:
+      slot = program_slot(prog, tok.variable);
+      flag = (slot < 0) ? -1 : program_emit(prog, OP_LOAD, slot, 1);
+      break;
+
+    case TYPE_ASSIGNMENT:
+      flag = program_emit(prog, OP_STORE, 0, -2);
+      break;
+
+    case TYPE_OPERATOR:
+      //OP_ADD to OP_DIV are in the same order as OPERATOR_PLUS to OPERATOR_DIV
+      flag = program_emit(prog, OP_ADD + tok.oper, 0, -1);
+      break;
+
+    case TYPE_PRINT:
+      flag = program_emit(prog, OP_PRINT, 0, -1);
+      break;
+
+    default:
+      flag = -1;
+      break;
+    }
+  }
+
+  return flag;
+}
+
+/* Gets the value of a stack entry, reading its slot if it is a reference.
+ * If the slot has never been assigned, return -1.
+ */
+static int program_resolve(Run_value *v, int *vals, char *defined, int *val) {
+  if(v->slot < 0) {
+    *val = v->val;
+    return 0;
+  }
+  if(defined[v->slot] == 0) {
+    return -1;
+  }
+  *val = vals[v->slot];
+  return 0;
+}
+
+/* Runs prog against symtab, calling emit(arg, value) for every print.
+ * Variables start with their values in symtab (if any), and every variable
+ *   the program assigns is written back to symtab when it stops.
+ * Returns -1 on any stack underflow, read of an unassigned variable,
+ *   assignment to a non-variable, division by zero or memory error, after
+ *   emitting everything printed up to that point.  Otherwise, returns 0.
+ */
+int program_run(Program *prog, Symtab *symtab, void (*emit)(void *arg, int val), void *arg) {
+  int *vals = NULL;
+  char *defined = NULL;
+  Run_value *stack = NULL;
+  Instr *code = NULL;
+  int sp = 0;
+  int pc = 0;
+  int i = 0;
+  int a = 0, b = 0;
+  int ret = 0;
+
+  if(prog == NULL || symtab == NULL) {
+    return -1;
+  }
+
+  vals = malloc(sizeof(int) * (prog->slot_count + 1));
+  defined = calloc(prog->slot_count + 1, sizeof(char));
+  stack = malloc(sizeof(Run_value) * (prog->max_depth + 1));
+  if(vals == NULL || defined == NULL || stack == NULL) {
+    free(vals);
+    free(defined);
+    free(stack);
+    return -1;
+  }
+
+  //Variables the program does not assign keep their values from symtab
+  for(i = 0; i < prog->slot_count; i++) {
+    defined[i] = (hash_get_value(symtab, prog->names[i], &vals[i]) == 0);
+  }
+
+  code = prog->code;
+  for(pc = 0; pc < prog->count && ret == 0; pc++) {
+    STATS_INC(opcodes[code[pc].op]);
+    switch(code[pc].op) {
+
+    case OP_PUSH:
+      stack[sp].slot = -1;
+      stack[sp].val = code[pc].arg;
+      sp++;
+      break;
+
+    case OP_LOAD:
+      stack[sp].slot = code[pc].arg;
+      sp++;
+      break;
+
+    case OP_STORE:
+      if(sp < 2 || stack[sp - 2].slot < 0 ||
+         program_resolve(&stack[sp - 1], vals, defined, &a) != 0) {
+        ret = -1;
+        break;
+      }
+      //2 marks the slot as assigned by the program, so it is written back
+      vals[stack[sp - 2].slot] = a;
+      defined[stack[sp - 2].slot] = 2;
+      sp -= 2;
+      break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+      if(sp < 2 ||
+         program_resolve(&stack[sp - 1], vals, defined, &a) != 0 ||
+         program_resolve(&stack[sp - 2], vals, defined, &b) != 0) {
+        ret = -1;
+        break;
+      }
+      sp--;
+      stack[sp - 1].slot = -1;
+      if(code[pc].op == OP_ADD) {
+        stack[sp - 1].val = b + a;
+      }
+      else if(code[pc].op == OP_SUB) {
+        stack[sp - 1].val = b - a;
+      }
+      else if(code[pc].op == OP_MUL) {
+        stack[sp - 1].val = b * a;
+      }
+      else if(a != 0) {
+        stack[sp - 1].val = b / a;
+      }
+      else {
+        ret = -1;
+      }
+      break;
+
+    case OP_PRINT:
+      if(sp < 1 || program_resolve(&stack[sp - 1], vals, defined, &a) != 0) {
+        ret = -1;
+        break;
+      }
+      sp--;
+      if(emit != NULL) {
+        emit(arg, a);
+      }
+      break;
+
+    default:
+      ret = -1;
+      break;
+    }
+  }
+
+  //Write every variable the program assigned back to symtab
+  for(i = 0; i < prog->slot_count; i++) {
+    if(defined[i] == 2 && hash_update(symtab, prog->names[i], vals[i]) != 0 &&
+       hash_put(symtab, prog->names[i], vals[i]) != 0) {
+      ret = -1;
+    }
+  }
+
+  free(vals);
+  free(defined);
+  free(stack);
+  return ret;
+}
+
+/* Returns a op b for one of OP_ADD to OP_DIV */
+static int program_apply(int op, int a, int b) {
+  switch(op) {
+    case OP_ADD: return a + b;
+    case OP_SUB: return a - b;
+    case OP_MUL: return a * b;
+    default: return a / b;
+  }
+}
+
+/* Constant folding.
+ * Replaces every operator whose two operands are constants pushed right
+ *   before it with a push of the result, so "1 2 + 3 *" becomes "9".
+ * Division by a constant zero (or INT_MIN by -1) is left for program_run.
+ * Returns the number of instructions removed.
+ */
+static int program_fold(Program *prog) {
+  int *sim = malloc(sizeof(int) * (prog->count + 1));
+  Instr *code = prog->code;
+  int sp = 0;
+  int out = 0;
+  int i = 0;
+  int top = 0, below = 0;
+
+  if(sim == NULL) {
+    return 0;
+  }
+
+  //sim holds, for each stack entry, the index in the output of the last
+  //instruction that produced it
+  for(i = 0; i < prog->count; i++) {
+    code[out] = code[i];
+
+    switch(code[i].op) {
+
+    case OP_PUSH:
+    case OP_LOAD:
+      sim[sp++] = out++;
+      break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+      if(sp < 2) {
+        //The program will underflow here when it runs; keep the rest as is
+        sp = -1;
+        break;
+      }
+      top = sim[sp - 1];
+      below = sim[sp - 2];
+      sp -= 2;
+      if(top == out - 1 && below == out - 2 &&
+         code[top].op == OP_PUSH && code[below].op == OP_PUSH &&
+         !(code[i].op == OP_DIV && (code[top].arg == 0 ||
+                                    (code[top].arg == -1 && code[below].arg == INT_MIN)))) {
+        code[below].arg = program_apply(code[i].op, code[below].arg, code[top].arg);
+        out = below;
+      }
+      else {
+        code[out] = code[i];
+      }
+      sim[sp++] = out++;
+      break;
+
+    case OP_STORE:
+    case OP_PRINT:
+      sp -= (code[i].op == OP_STORE) ? 2 : 1;
+      if(sp < 0) {
+        sp = -1;
+        break;
+      }
+      out++;
+      break;
+    }
+
+    if(sp < 0) {
+      //Copy the remainder of the program over unchanged
+      out++;
+      for(i = i + 1; i < prog->count; i++) {
+        code[out++] = code[i];
+      }
+      break;
+    }
+  }
+
+  free(sim);
+  i = prog->count - out;
+  prog->count = out;
+  return i;
+}
+
+/* Marks the store that a read of stack entry e (produced by instruction
+ *   e) at instruction i depends on as live.
+ * Returns 0 if the read is known to succeed (e is a constant, a result,
+ *   or a variable some earlier store has assigned), otherwise 1.
+ */
+static int program_read(Instr *code, int e, int *last_store, char *live) {
+  if(code[e].op != OP_LOAD) {
+    return 0;
+  }
+  if(last_store[code[e].arg] < 0) {
+    return 1;
+  }
+  live[last_store[code[e].arg]] = 1;
+  return 0;
+}
+
+/* Dead store elimination (one pass).
+ * A store is dead if no instruction reads the variable before it is
+ *   stored again or the program ends.  A dead store is removed together
+ *   with its target and the expression computing its value, as long as
+ *   that expression cannot fail (no stores or prints inside, no reads of
+ *   variables that might be unassigned, no division by a non-constant).
+ * Returns the number of instructions removed, or -1 on any memory errors.
+ */
+static int program_dead_stores(Program *prog) {
+  int n = prog->count;
+  Instr *code = prog->code;
+  int *start = malloc(sizeof(int) * (n + 1));
+  int *sim = malloc(sizeof(int) * (n + 1));
+  int *target = malloc(sizeof(int) * (n + 1));
+  int *value = malloc(sizeof(int) * (n + 1));
+  int *bad = calloc(n + 1, sizeof(int));
+  char *live = calloc(n + 1, sizeof(char));
+  char *drop = calloc(n + 1, sizeof(char));
+  int *last_store = malloc(sizeof(int) * (prog->slot_count + 1));
+  int sp = 0;
+  int out = 0;
+  int i = 0, j = 0;
+  int l = 0, r = 0;
+  int ret = 0;
+
+  if(start == NULL || sim == NULL || target == NULL || value == NULL ||
+     bad == NULL || live == NULL || drop == NULL || last_store == NULL) {
+    ret = -1;
+    goto done;
+  }
+
+  for(i = 0; i < prog->slot_count; i++) {
+    last_store[i] = -1;
+  }
+
+  //Rebuild the expression tree: start[i] is where the expression that
+  //instruction i produces begins, bad[i] is set if i must not be dropped
+  for(i = 0; i < n; i++) {
+    switch(code[i].op) {
+
+    case OP_PUSH:
+    case OP_LOAD:
+      start[i] = i;
+      sim[sp++] = i;
+      break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+      if(sp < 2) {
+        goto done;
+      }
+      r = sim[--sp];
+      l = sim[--sp];
+      bad[i] = program_read(code, r, last_store, live) | program_read(code, l, last_store, live);
+      if(code[i].op == OP_DIV && !(code[r].op == OP_PUSH && code[r].arg != 0)) {
+        bad[i] = 1;
+      }
+      start[i] = start[l];
+      sim[sp++] = i;
+      break;
+
+    case OP_STORE:
+      if(sp < 2) {
+        goto done;
+      }
+      value[i] = sim[--sp];
+      l = sim[--sp];
+      bad[i] = 1;
+      //The value is read before the target is assigned
+      r = program_read(code, value[i], last_store, live);
+      if(code[l].op == OP_LOAD) {
+        last_store[code[l].arg] = i;
+      }
+      //A store whose value might fail to read can never be dropped
+      target[i] = (r == 0 && code[l].op == OP_LOAD) ? l : -1;
+      break;
+
+    case OP_PRINT:
+      if(sp < 1) {
+        goto done;
+      }
+      program_read(code, sim[--sp], last_store, live);
+      bad[i] = 1;
+      break;
+    }
+  }
+
+  //Turn bad into a running count so any range can be checked at once
+  for(i = 0; i < n; i++) {
+    bad[i + 1] += bad[i];
+  }
+  for(i = n; i > 0; i--) {
+    bad[i] = bad[i - 1];
+  }
+  bad[0] = 0;
+
+  //Drop every dead store whose value expression cannot fail
+  for(i = 0; i < n; i++) {
+    if(code[i].op != OP_STORE || live[i] || target[i] < 0) {
+      continue;
+    }
+    l = start[value[i]];
+    r = value[i];
+    if(bad[r + 1] - bad[l] != 0) {
+      continue;
+    }
+    drop[i] = 1;
+    drop[target[i]] = 1;
+    for(j = l; j <= r; j++) {
+      drop[j] = 1;
+    }
+  }
+
+  for(i = 0; i < n; i++) {
+    if(!drop[i]) {
+      code[out++] = code[i];
+    }
+  }
+  ret = n - out;
+  prog->count = out;
+
+done:
+  free(start);
+  free(sim);
+  free(target);
+  free(value);
+  free(bad);
+  free(live);
+  free(drop);
+  free(last_store);
+  return ret;
+}
+
+/* Optimizes a compiled program in place.
+ * flags is a mix of OPT_FOLD (constant folding) and OPT_DEAD_STORES (dead
+ *   store elimination).  Dead store elimination also drops the last store
+ *   to a variable if nothing reads it, so only use it when the Symtab the
+ *   program runs against is not looked at afterwards.
+ * Returns the number of instructions (tokens) removed, or -1 on any memory
+ *   errors (prog is still valid).
+ */
+int program_optimize(Program *prog, int flags) {
+  int removed = 0;
+  int ret = 0;
+  int depth = 0;
+  int i = 0;
+
+  if(prog == NULL) {
+    return -1;
+  }
+
+  if(flags & OPT_FOLD) {
+    removed += program_fold(prog);
+  }
+  //Dropping a store can leave the stores its value read from dead too
+  if(flags & OPT_DEAD_STORES) {
+    do {
+      ret = program_dead_stores(prog);
+      removed += (ret > 0) ? ret : 0;
+    } while(ret > 0);
+  }
+
+  //Work out how deep the stack now gets
+  prog->depth = 0;
+  prog->max_depth = 0;
+  for(i = 0; i < prog->count; i++) {
+    switch(prog->code[i].op) {
+      case OP_PUSH: case OP_LOAD: depth = 1; break;
+      case OP_STORE: depth = -2; break;
+      default: depth = -1; break;
+    }
+    prog->depth = (prog->depth + depth < 0) ? 0 : prog->depth + depth;
+    if(prog->depth > prog->max_depth) {
+      prog->max_depth = prog->depth;
+    }
+  }
+
+  return (ret < 0) ? -1 : removed;
+}
@@ -0,0 +1,65 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "token.h"
+#include "symbol.h"
+
+/* Program Opcodes
+ * OP_PUSH pushes the constant arg.
+ * OP_LOAD pushes a reference to variable slot arg.  Like a variable token,
+ * -- it is only read when an instruction uses it.
+ * OP_STORE pops a value and a slot reference and stores the value.
+ * OP_ADD to OP_DIV pop two values and push the result.
+ * OP_PRINT pops a value and emits it.
+ */
+#define OP_PUSH  0
+#define OP_LOAD  1
+#define OP_STORE 2
+#define OP_ADD   3
+#define OP_SUB   4
+#define OP_MUL   5
+#define OP_DIV   6
+#define OP_PRINT 7
+
+#define PROGRAM_INITIAL 64
+
+/* program_optimize flags */
+#define OPT_FOLD        1
+#define OPT_DEAD_STORES 2
+
+/* Instruction Structure */
+typedef struct instr_struct {
+  int op;
+  int arg;
+} Instr;
+
+/* Program Structure
+ * A compiled RPN program.  Every variable name is interned once to an
+ * integer slot, so running the program never hashes or compares names.
+ * code is the array of count instructions (room for capacity)
+ * names holds the name of each of the slot_count slots (room for
+ * -- slot_capacity)
+ * slots maps each name to its slot while compiling
+ * depth is how deep the stack is after the code compiled so far
+ * max_depth is the deepest the stack gets, so the executor can size it
+ */
+typedef struct program_struct {
+  int count;
+  int capacity;
+  Instr *code;
+  int slot_count;
+  int slot_capacity;
+  char (*names)[MAX_VAR_LEN];
+  Symtab *slots;
+  int depth;
+  int max_depth;
+} Program;
+
+/* Program Function Prototypes */
+Program *program_initialize();
+void program_destroy(Program *prog);
+int program_compile(Program *prog, Token_ctx *ctx);
+int program_optimize(Program *prog, int flags);
+int program_run(Program *prog, Symtab *symtab, void (*emit)(void *arg, int val), void *arg);
+
+#endif
@@ -1,183 +1,781 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
+#include "rpn.h"
 #include "stack.h"
 #include "token.h"
 #include "hash.h"
+#include "program.h"
+#include "outbuf.h"
+#include "stats.h"
+#include "column.h"
+#include "par.h"
+
+/* Defines the size of each chunk of program text handed to the tokenizer,
+ * and so the longest token a program may hold */
+#define CHUNK_LEN 4096
+
+/* Streaming reader state for one program file, or for a stream such as
+ * stdin (fp is then NULL and fd is read directly).
+ * buf holds the chunk currently being tokenized plus any partial token
+ * carried over from the previous read.
+ */
+typedef struct reader_struct {
+  FILE *fp;
+  int fd;
+  int eof;  /* Set once the file or stream has no more to give */
+  int len;  /* Number of bytes currently held in buf */
+  int cut;  /* Number of bytes handed out by the last read_chunk */
+  char buf[CHUNK_LEN + 1];
+} Reader;
+
+/* Where a compiled program's output goes (the arg of emit_output) */
+typedef struct output_struct {
+  Outbuf *out;
+  int trace;
+} Output;
 
 /* Local Function Declarations */
-static int read_file(char *filename, char *line);
-static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok);
-static void print_header(char *filename, int step);
-static void print_step_header(int step);
-static void print_step_footer(Symtab *symtab, Stack_head *stack);
-static void print_step_output(int val);
-
-/* Defines the largest line that can be read from a file */
-#define MAX_LINE_LEN 255
+static int read_file(char *filename, Reader *reader);
+static int read_chunk(Reader *reader);
+static int get_operand_value(Symtab *symtab, Token *tok, int *val);
+static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok, Outbuf *out, int trace);
+static int run_traced(Stack_head *stack, Symtab *symtab, char *filename, Outbuf *out, Rpn_options *opts);
+static int run_reader(Stack_head *stack, Symtab *symtab, Reader *reader, char *name, Outbuf *out, Rpn_options *opts);
+static int run_compiled(Symtab *symtab, char *filename, Outbuf *out, Rpn_options *opts);
+static int run_source(Symtab *symtab, char *source, int len, Outbuf *out, Rpn_options *opts, int trace);
+static Program *compile_file(char *filename, Outbuf *out, Rpn_options *opts);
+static Program *compile_source(char *source, int len, Outbuf *out, Rpn_options *opts);
+static int optimize(Program *prog, Rpn_options *opts);
+static char *read_source(char *filename, int *len);
+static int fail_read(Outbuf *out, char *filename);
+static int fail_parse(Outbuf *out);
+static void print_header(Outbuf *out, Token_ctx *ctx, char *filename, int step);
+static void print_step_header(Outbuf *out, int step);
+static void print_step_footer(Outbuf *out, Token_ctx *ctx, Symtab *symtab, Stack_head *stack);
+static void print_step_output(Outbuf *out, int trace, int val);
+static void emit_output(void *arg, int val);
 
 /* Main function to run your program.
  * 1) Opens the file using the passed in filename.
  * -- If the file is not found (ie. fopen returns NULL), then exit(-1);
- * 2) Reads one line from the file.
- * -- The programs will all only be one line in size.
- * -- That line may be up to MAX_LINE_LEN long.
- * 3) Closes the file.
- * 4) Calls token_read_line(line, strlen(line))
- * -- This parses the line and prepares the tokens to be ready to get.
- * 5) While there are tokens remaining to parse: token_has_next() != 0
- * -- a) Get the next token: token_get_next()
- * 6) Parse the token (your function)
- * 7) Print out all of the relevant information
+ * 2) Reads the program one chunk (up to CHUNK_LEN) at a time.
+ * -- Programs may be any size and span any number of lines.
+ * -- Chunks always end on a delimiter, so no token is split between two.
+ * -- A token longer than CHUNK_LEN is an error.
+ * 3) Calls token_ctx_read_line(ctx, chunk, len) on each chunk
+ * -- Each call to rpn() has its own tokenizer context, so several programs
+ * -- can be run at once.
+ * -- This parses the chunk and prepares the tokens to be ready to get.
+ * 4) While there are tokens remaining to parse: token_ctx_has_next() != 0
+ * -- a) Decode the next token without copying: token_ctx_next()
+ * 5) Parse the token (your function)
+ * 6) Print out all of the relevant information
+ * 7) Closes the file once the last chunk has been parsed.
+ * On any error, exit(-1) once the output so far and the error are printed.
  */
 int rpn(Stack_head *stack, Symtab *symtab, char *filename) {
-  int step = 0; /* Used to track the program steps */
+  Rpn_options opts = { TRACE_FULL, 1, 0, 0, NULL, NULL, 0 };
+
+  if(rpn_run(stack, symtab, filename, &opts) != 0) {
+    exit(-1);
+  }
+  return 0;
+}
+
+/* Runs a program file like rpn(), with the given options.
+ * With TRACE_QUIET none of the trace is built or printed at all; with
+ *   TRACE_SAMPLED only every opts->sample'th step is.
+ * If opts->compiled is set the program is compiled to bytecode and run
+ *   without a per step trace instead (see run_compiled).
+ * All output goes through opts->out, and is flushed when the program ends.
+ *   If opts->out is NULL a buffer on stdout is used for this run.
+ * Unlike rpn(), errors do not exit: the error message is written after the
+ *   output so far and -1 is returned.
+ */
+int rpn_run(Stack_head *stack, Symtab *symtab, char *filename, Rpn_options *opts) {
+  int ret = 0;
+  Outbuf *out = opts->out;
+
+  if(out == NULL) {
+    //Anything printf has buffered must come out before this run's output
+    fflush(stdout);
+    out = outbuf_initialize(STDOUT_FILENO);
+    if(out == NULL) {
+      printf("Critical Error in Parsing.  Exiting Program!\n");
+      return -1;
+    }
+  }
+
+  if(opts->compiled) {
+    ret = run_compiled(symtab, filename, out, opts);
+  }
+  else {
+    ret = run_traced(stack, symtab, filename, out, opts);
+  }
+
+  if(out != opts->out) {
+    outbuf_destroy(out);
+  }
+  else {
+    outbuf_flush(out);
+  }
+  STATS_DUMP(filename);
+  return ret;
+}
+
+/* Local function to run a program file token by token, printing the trace
+ *   that opts asks for.  See rpn_run.
+ * On any error, the message is written to out and -1 is returned.
+ */
+static int run_traced(Stack_head *stack, Symtab *symtab, char *filename, Outbuf *out, Rpn_options *opts) {
   int ret = 0;
-  char line[MAX_LINE_LEN];
-  Token *tok = NULL;
+  Reader reader;
 
-  /* Complete the read_file function that is defined later in this file. */
-  ret = read_file(filename, line);
+  /* Open the file for streaming */
+  ret = read_file(filename, &reader);
   if(ret != 0) {
-    printf("Error: Cannot Read File %s.  Exiting\n", filename);
-    exit(-1);
+    return fail_read(out, filename);
+  }
+
+  ret = run_reader(stack, symtab, &reader, filename, out, opts);
+  fclose(reader.fp);
+  return ret;
+}
+
+/* Runs the program arriving on fd (such as stdin) token by token, like
+ *   rpn_run, as it arrives.
+ * Every complete token (one followed by whitespace) is run as soon as it
+ *   is read, without waiting for the rest of the program, and the output
+ *   so far is flushed before each wait for more; so print output never
+ *   waits on input that has not been sent yet.
+ * stack and symtab carry over from line to line for as long as the stream
+ *   lasts.  opts->compiled is ignored: a stream is never compiled.
+ * Errors end the stream as they end a file: the message is written after
+ *   the output so far and -1 is returned.
+ */
+int rpn_stream(Stack_head *stack, Symtab *symtab, int fd, Rpn_options *opts) {
+  int ret = 0;
+  Outbuf *out = opts->out;
+  Reader reader;
+
+  if(out == NULL) {
+    fflush(stdout);
+    out = outbuf_initialize(STDOUT_FILENO);
+    if(out == NULL) {
+      printf("Critical Error in Parsing.  Exiting Program!\n");
+      return -1;
+    }
+  }
+
+  reader.fp = NULL;
+  reader.fd = fd;
+  reader.eof = 0;
+  reader.len = 0;
+  reader.cut = 0;
+  reader.buf[0] = '\0';
+  ret = run_reader(stack, symtab, &reader, "stdin", out, opts);
+
+  if(out != opts->out) {
+    outbuf_destroy(out);
+  }
+  else {
+    outbuf_flush(out);
+  }
+  return ret;
+}
+
+/* Local function to run everything reader hands out token by token,
+ *   printing the trace that opts asks for under the program name name.
+ * A stream's output is flushed each time its chunk has been run.
+ * On any error, the message is written to out and -1 is returned.
+ */
+static int run_reader(Stack_head *stack, Symtab *symtab, Reader *reader, char *name, Outbuf *out, Rpn_options *opts) {
+  int step = 0; /* Used to track the program steps */
+  int ret = 0;
+  int len = 0;
+  int traced = 0; /* Whether the current step is traced */
+  Token_ctx *ctx = NULL;
+  Token tok;
+
+  /* Create the tokenizer for this program */
+  ctx = token_ctx_initialize();
+  if(ctx == NULL) {
+    return fail_parse(out);
   }
 
-  /* Pass the line into the tokenizer to initialize that system */
-  token_read_line(line, strlen(line));
+  /* Pass the first chunk into the tokenizer to initialize that system */
+  len = read_chunk(reader);
+  if(len < 0) {
+    token_ctx_destroy(ctx);
+    return fail_parse(out);
+  }
+  token_ctx_read_line(ctx, reader->buf, len);
+  token_ctx_set_more(ctx, !reader->eof);
 
   /* Prints out the nice program output header */
-  print_header(filename, step);
-
-  /* Iterate through all tokens */
-  while(token_has_next()) {
-    /* Begin the next step of execution and print out the step header */
-    step++; /* Begin the next step of execution */
-    print_step_header(step);
-
-    /* Get the next token */
-    tok = token_get_next();
-    /* Complete the implementation of this function later in this file. */
-    ret = parse_token(symtab, stack, tok);
-    if(ret != 0) {
+  if(opts->trace != TRACE_QUIET) {
+    print_header(out, ctx, name, step);
+  }
+
+  /* Iterate through all chunks of the file */
+  while(len > 0) {
+    /* Iterate through all tokens in this chunk */
+    while(token_ctx_has_next(ctx)) {
+      /* Begin the next step of execution and print out the step header */
+      step++; /* Begin the next step of execution */
+      traced = (opts->trace == TRACE_FULL) ||
+               (opts->trace == TRACE_SAMPLED && step % opts->sample == 0);
+      if(traced) {
+        print_step_header(out, step);
+      }
+
+      /* Decode the next token in place, straight from the chunk */
+      token_ctx_next(ctx, &tok);
+      /* Complete the implementation of this function later in this file. */
+      ret = parse_token(symtab, stack, &tok, out, opts->trace);
+      if(ret != 0) {
+        token_ctx_destroy(ctx);
+        return fail_parse(out);
+      }
+
+      /* Prints out the end of step information */
+      if(traced) {
+        print_step_footer(out, ctx, symtab, stack);
+      }
+    }
+
+    /* A stream may wait a while for its next chunk, so send what is done */
+    if(reader->fp == NULL) {
+      outbuf_flush(out);
+    }
+
+    /* Refill the tokenizer with the next chunk */
+    len = read_chunk(reader);
+    if(len < 0) {
+      token_ctx_destroy(ctx);
+      return fail_parse(out);
+    }
+    if(len > 0) {
+      token_ctx_read_line(ctx, reader->buf, len);
+      token_ctx_set_more(ctx, !reader->eof);
+    }
+  }
+
+  token_ctx_destroy(ctx);
+  return 0;
+}
+
+/* Runs a program file once for every binding in a CSV file of inputs.
+ * The program is compiled once (and optimized if opts->optimize is set)
+ *   and then run over whole columns of bindings; see column_run for the
+ *   CSV layout and the output, which goes to opts->out (or stdout).
+ * There is no trace, and no Symbol Table: every variable the program reads
+ *   must be bound in the CSV or assigned first.
+ * On any error the message is written after the output so far and -1 is
+ *   returned.
+ */
+int rpn_columns(char *filename, char *bindings, Rpn_options *opts) {
+  Outbuf *out = opts->out;
+  Program *prog = NULL;
+  FILE *csv = NULL;
+  int ret = 0;
+
+  if(out == NULL) {
+    fflush(stdout);
+    out = outbuf_initialize(STDOUT_FILENO);
+    if(out == NULL) {
       printf("Critical Error in Parsing.  Exiting Program!\n");
-      exit(-1);
+      return -1;
     }
+  }
+
+  prog = compile_file(filename, out, opts);
+  if(prog == NULL) {
+    ret = -1;
+  }
+  else {
+    csv = fopen(bindings, "r");
+    if(csv == NULL) {
+      ret = fail_read(out, bindings);
+    }
+    else if(column_run(prog, csv, out) != 0) {
+      ret = fail_parse(out);
+    }
+  }
 
-    /* Prints out the end of step information */
-    print_step_footer(symtab, stack);
+  if(csv != NULL) {
+    fclose(csv);
   }
+  program_destroy(prog);
+  if(out != opts->out) {
+    outbuf_destroy(out);
+  }
+  else {
+    outbuf_flush(out);
+  }
+  return ret;
+}
+
+/* Runs len bytes of program text already in memory (NUL terminated), such
+ *   as one request to the server, against stack and symtab.
+ * Only the output of print tokens is written, one value per line as with
+ *   TRACE_QUIET, to opts->out; it must not be NULL and is not flushed.
+ * If opts->compiled is set the text is compiled first (see run_source),
+ *   otherwise it is run token by token like rpn().
+ * On any error the message is written after the output so far and -1 is
+ *   returned.
+ */
+int rpn_eval(Stack_head *stack, Symtab *symtab, char *source, int len, Rpn_options *opts) {
+  Outbuf *out = opts->out;
+  Token_ctx *ctx = NULL;
+  Token tok;
+  int ret = 0;
 
+  if(out == NULL || source == NULL) {
+    return -1;
+  }
+  if(opts->compiled) {
+    return run_source(symtab, source, len, out, opts, TRACE_QUIET);
+  }
+
+  ctx = token_ctx_initialize();
+  if(ctx == NULL) {
+    return fail_parse(out);
+  }
+  //An empty program has no tokens at all
+  if(len > 0 && token_ctx_read_line(ctx, source, len) == 0) {
+    while(ret == 0 && token_ctx_has_next(ctx)) {
+      token_ctx_next(ctx, &tok);
+      ret = parse_token(symtab, stack, &tok, out, TRACE_QUIET);
+    }
+  }
+  token_ctx_destroy(ctx);
+
+  if(ret != 0) {
+    return fail_parse(out);
+  }
   return 0;
 }
 
-/* Local function to open a file or exit.
- * Open filename, read its contents (up to MAX_LINE_LEN) into line, then
- *   close the file and return 0.
- * On any file error, return -1.
+/* Local function to run a program file by compiling it to bytecode first.
+ * 1) Compiles the file (see compile_file).
+ * -- With opts->cache, the whole file is read and run with run_source, so
+ * -- its Program is only compiled if it is not already cached.
+ * 2) Runs the Program against symtab (on opts->parallel threads, see
+ * -- par_run), printing the output of every print token just as rpn()
+ * -- does (without the per step trace).
+ * On any file error, compile error or run error, the message is written to
+ *   out and -1 is returned.
  */
-static int read_file(char *filename, char *line) {
+static int run_compiled(Symtab *symtab, char *filename, Outbuf *out, Rpn_options *opts) {
+  Program *prog = NULL;
+  Output output = { out, opts->trace };
+  char *source = NULL;
+  int len = 0;
+  int ret = 0;
+
+  if(opts->cache != NULL) {
+    source = read_source(filename, &len);
+    if(source == NULL) {
+      return fail_read(out, filename);
+    }
+    ret = run_source(symtab, source, len, out, opts, opts->trace);
+    free(source);
+    return ret;
+  }
 
-  if(filename == NULL) {
+  prog = compile_file(filename, out, opts);
+  if(prog == NULL) {
     return -1;
   }
-  //Open file in read mode
+  ret = par_run(prog, symtab, opts->parallel, emit_output, &output);
+  program_destroy(prog);
+
+  if(ret != 0) {
+    return fail_parse(out);
+  }
+  return 0;
+}
+
+/* Local function to compile len bytes of program text in memory and run
+ *   the Program against symtab, printing print tokens at the given trace
+ *   level.
+ * With opts->cache the Program is looked up in the cache first; it is
+ *   only compiled (and then cached) on a miss.
+ * On any compile error or run error, the message is written to out and
+ *   -1 is returned.
+ */
+static int run_source(Symtab *symtab, char *source, int len, Outbuf *out, Rpn_options *opts, int trace) {
+  Program *prog = NULL;
+  Cache_entry *entry = NULL;
+  Output output = { out, trace };
+  int ret = 0;
+
+  if(opts->cache != NULL) {
+    entry = cache_acquire(opts->cache, source, len, opts->optimize);
+  }
+  if(entry != NULL) {
+    prog = entry->prog;
+  }
+  else {
+    prog = compile_source(source, len, out, opts);
+    if(prog == NULL) {
+      return -1;
+    }
+    if(opts->cache != NULL) {
+      entry = cache_insert(opts->cache, source, len, opts->optimize, prog);
+      if(entry == NULL) {
+        return fail_parse(out);
+      }
+      prog = entry->prog;
+    }
+  }
+
+  ret = par_run(prog, symtab, opts->parallel, emit_output, &output);
+  if(entry != NULL) {
+    cache_release(opts->cache, entry);
+  }
+  else {
+    program_destroy(prog);
+  }
+
+  if(ret != 0) {
+    return fail_parse(out);
+  }
+  return 0;
+}
+
+/* Local function to compile a program file to bytecode.
+ * 1) Opens the file, exactly as rpn() does.
+ * 2) Compiles it chunk by chunk into a Program, interning every variable
+ * -- name to a slot once.
+ * 3) Optimizes the Program if asked to (see optimize).
+ * On any file or compile error, the message is written to out and NULL is
+ *   returned.
+ */
+static Program *compile_file(char *filename, Outbuf *out, Rpn_options *opts) {
+  int ret = 0;
+  int len = 0;
+  Reader reader;
+  Token_ctx *ctx = NULL;
+  Program *prog = NULL;
+
+  ret = read_file(filename, &reader);
+  if(ret != 0) {
+    fail_read(out, filename);
+    return NULL;
+  }
+
+  ctx = token_ctx_initialize();
+  prog = program_initialize();
+  if(ctx == NULL || prog == NULL) {
+    token_ctx_destroy(ctx);
+    program_destroy(prog);
+    fclose(reader.fp);
+    fail_parse(out);
+    return NULL;
+  }
+
+  //Compile every chunk of the file onto the end of the program
+  len = read_chunk(&reader);
+  while(len > 0 && ret == 0) {
+    token_ctx_read_line(ctx, reader.buf, len);
+    ret = program_compile(prog, ctx);
+    len = read_chunk(&reader);
+  }
+  token_ctx_destroy(ctx);
+  fclose(reader.fp);
+
+  if(ret == 0 && len < 0) {
+    ret = -1;
+  }
+  if(ret == 0) {
+    ret = optimize(prog, opts);
+  }
+  if(ret != 0) {
+    program_destroy(prog);
+    fail_parse(out);
+    return NULL;
+  }
+  return prog;
+}
+
+/* Local function to compile len bytes of program text already in memory,
+ *   just as compile_file compiles a file.
+ * source must be NUL terminated.
+ * On any compile error, the message is written to out and NULL is returned.
+ */
+static Program *compile_source(char *source, int len, Outbuf *out, Rpn_options *opts) {
+  int ret = 0;
+  Token_ctx *ctx = token_ctx_initialize();
+  Program *prog = program_initialize();
+
+  if(ctx == NULL || prog == NULL) {
+    token_ctx_destroy(ctx);
+    program_destroy(prog);
+    fail_parse(out);
+    return NULL;
+  }
+
+  //An empty program compiles to no code at all
+  if(len > 0 && token_ctx_read_line(ctx, source, len) == 0) {
+    ret = program_compile(prog, ctx);
+  }
+  token_ctx_destroy(ctx);
+
+  if(ret == 0) {
+    ret = optimize(prog, opts);
+  }
+  if(ret != 0) {
+    program_destroy(prog);
+    fail_parse(out);
+    return NULL;
+  }
+  return prog;
+}
+
+/* Local function to run program_optimize on a freshly compiled Program if
+ *   opts->optimize is non-zero, reporting how many tokens it removed on
+ *   stderr.
+ * Returns 0 on success or -1 if the optimizer failed.
+ */
+static int optimize(Program *prog, Rpn_options *opts) {
+  int count = prog->count;
+  int removed = 0;
+
+  if(opts->optimize == 0) {
+    return 0;
+  }
+  removed = program_optimize(prog, opts->optimize);
+  if(removed < 0) {
+    return -1;
+  }
+  fprintf(stderr, "Optimizer removed %d of %d tokens\n", removed, count);
+  return 0;
+}
+
+/* Local function to read a whole file into memory.
+ * Returns the NUL terminated contents (to be freed) and sets *len to their
+ *   length, or returns NULL on any file or memory error.
+ */
+static char *read_source(char *filename, int *len) {
   FILE *fp = fopen(filename, "r");
+  char *source = NULL;
+  char *bigger = NULL;
+  int capacity = CHUNK_LEN;
+  int n = 0;
 
   if(fp == NULL) {
+    return NULL;
+  }
+  source = malloc(capacity + 1);
+  *len = 0;
+  while(source != NULL) {
+    n = fread(source + *len, 1, capacity - *len, fp);
+    *len += n;
+    if(*len < capacity) {
+      break;
+    }
+    bigger = realloc(source, capacity * 2 + 1);
+    if(bigger == NULL) {
+      free(source);
+    }
+    source = bigger;
+    capacity *= 2;
+  }
+
+  if(source != NULL && ferror(fp)) {
+    free(source);
+    source = NULL;
+  }
+  fclose(fp);
+  if(source != NULL) {
+    source[*len] = '\0';
+  }
+  return source;
+}
+
+/* Local function to report a file that cannot be read.
+ * The message follows the output so far; returns -1.
+ */
+static int fail_read(Outbuf *out, char *filename) {
+  outbuf_str(out, "Error: Cannot Read File ");
+  outbuf_str(out, filename);
+  outbuf_str(out, ".  Exiting\n");
+  return -1;
+}
+
+/* Local function to report an error in a program.
+ * The message follows the output so far; returns -1.
+ */
+static int fail_parse(Outbuf *out) {
+  outbuf_str(out, "Critical Error in Parsing.  Exiting Program!\n");
+  return -1;
+}
+
+/* Local function to open a file for streaming.
+ * Open filename and prepare reader to hand out its contents in chunks,
+ *   then return 0.
+ * On any file error, return -1.
+ */
+static int read_file(char *filename, Reader *reader) {
+
+  if(filename == NULL || reader == NULL) {
     return -1;
   }
+  //Open file in read mode
+  reader->fp = fopen(filename, "r");
 
-  while(feof(fp) == 0) { // Run until EOF is reached
-    fgets(line, MAX_LINE_LEN, fp); // Get one line from file
+  if(reader->fp == NULL) {
+    return -1;
   }
 
-  fclose(fp);
+  reader->fd = -1;
+  reader->eof = 0;
+  reader->len = 0;
+  reader->cut = 0;
+  reader->buf[0] = '\0';
   return 0;
 }
 
+/* Local function to read the next chunk of the file into reader->buf.
+ * The chunk always ends on a delimiter of the tokenizer (or at the end of
+ *   the file) so that a token is never split across two chunks.  Bytes
+ *   after the last delimiter are kept and placed in front of the next chunk.
+ * A file is read a whole buffer at a time; a stream hands out whatever
+ *   complete tokens have arrived, waiting only while it has none.
+ * Returns the length of the chunk, or 0 once the file is exhausted.
+ * If a single token fills all CHUNK_LEN bytes before the end of the file,
+ *   it is too long to run: return -1.
+ */
+static int read_chunk(Reader *reader) {
+  int n = 0;
+  int i = 0;
+
+  //Drop the chunk handed out last time and keep the partial token after it
+  reader->len -= reader->cut;
+  memmove(reader->buf, reader->buf + reader->cut, reader->len);
+  reader->cut = 0;
+
+  while(reader->cut == 0) {
+    //Top the buffer back up from the file
+    if(reader->fp != NULL) {
+      n = fread(reader->buf + reader->len, 1, CHUNK_LEN - reader->len, reader->fp);
+      reader->eof = feof(reader->fp) || ferror(reader->fp);
+    }
+    else if(!reader->eof) {
+      do {
+        n = read(reader->fd, reader->buf + reader->len, CHUNK_LEN - reader->len);
+      } while(n < 0 && errno == EINTR);
+      reader->eof = (n <= 0);
+      n = (n < 0) ? 0 : n;
+    }
+    reader->len += n;
+
+    if(reader->len == 0) {
+      return 0;
+    }
+
+    //At the end of the file everything left is the final chunk
+    if(reader->eof) {
+      reader->cut = reader->len;
+    }
+    else {
+      //Otherwise end the chunk just after the last delimiter in the buffer
+      for(i = reader->len - 1; i >= 0; i--) {
+        if(token_is_delimiter(reader->buf[i])) {
+          break;
+        }
+      }
+      //A single token filling the whole buffer is too long to run;
+      //a stream with only part of a token so far reads on
+      if(i >= 0) {
+        reader->cut = i + 1;
+      }
+      else if(reader->len == CHUNK_LEN) {
+        return -1;
+      }
+    }
+  }
+
+  reader->buf[reader->len] = '\0';
+  return reader->cut;
+}
+
+/* Gets the value of an operand popped off the stack.
+ * Values are used as they are; variables are looked up in symtab without
+ *   copying their Symbol.
+ * If the variable is not in symtab, return -1.
+ */
+static int get_operand_value(Symtab *symtab, Token *tok, int *val) {
+  if(tok->type == TYPE_VALUE) {
+    *val = tok->value;
+    return 0;
+  }
+  if(tok->type == TYPE_VARIABLE) {
+    return hash_get_value(symtab, tok->variable, val);
+  }
+  return -1;
+}
+
 /* Parses the Token to implement the rpn calculator features
  * You may implement this how you like, but many small functions would be good!
+ * tok belongs to the caller; operands are copied onto the stack.
+ * out and trace (the TRACE_ level) are used to print the output of print tokens.
  * If the token you are passed in is NULL, return -1.
  * If there are any memory errors, return -1.
  */
-static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok) {
+static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok, Outbuf *out, int trace) {
 
   int flag = -1;
-  Token *tok_temp = NULL;
-  Token *tok_temp1 = NULL;
-  Token *tok_temp2 = NULL;
-  Token *tok_temp3 = NULL;
+  Token tok_temp;
+  Token tok_temp1;
+  Token tok_temp2;
   int temp1 = -1, temp2 = -1, temp3 = -1;
 
   if (symtab == NULL || stack == NULL || tok == NULL) {
     return -1;
   }
+  STATS_INC(tokens[tok->type]);
 
   //Switch case for the type of token
   switch (tok->type) {
 
   case TYPE_ASSIGNMENT:
   //Pop two tokens off the stack. 
-    tok_temp1 = stack_pop(stack);
-    tok_temp2 = stack_pop(stack);
-
-    if (tok_temp1 == NULL || tok_temp2 == NULL) {
+    if (stack_pop_value(stack, &tok_temp1) != 0 || stack_pop_value(stack, &tok_temp2) != 0) {
       return -1;
     }
 
-    temp1 = tok_temp1->value;
-
-    //If tok_temp1 is a variable, then search for its value in hash table and assign it to variable of tok_temp2
-    if(tok_temp1->type == TYPE_VARIABLE) {
-      Symbol *temp_symbol = hash_get(symtab, tok_temp1->variable);
-      temp1 = temp_symbol->val;      
-      symbol_free(temp_symbol);
-      temp_symbol = NULL;
+    //Get the value being assigned (looking it up if tok_temp1 is a variable)
+    if (get_operand_value(symtab, &tok_temp1, &temp1) != 0 || tok_temp2.type != TYPE_VARIABLE) {
+      return -1;
     }
 
-    //Assign the value of tok_temp1 to variable of tok_temp2.
-    flag = hash_put(symtab, tok_temp2->variable, temp1);
+    //Assign the value of tok_temp1 to variable of tok_temp2, in place if it already exists
+    if (hash_update(symtab, tok_temp2.variable, temp1) != 0) {
+      flag = hash_put(symtab, tok_temp2.variable, temp1);
 
-    if (flag != 0) {
-      return -1;
+      if (flag != 0) {
+        return -1;
+      }
     }
-
-    token_free(tok_temp1);
-    tok_temp1 = NULL;
-    token_free(tok_temp2);
-    tok_temp2 = NULL;
-    token_free(tok);
-    tok = NULL;
     break;
 
   case TYPE_OPERATOR:
-    tok_temp1 = stack_pop(stack);
-    tok_temp2 = stack_pop(stack);
-
-    if (tok_temp1 == NULL || tok_temp2 == NULL) {
+    if (stack_pop_value(stack, &tok_temp1) != 0 || stack_pop_value(stack, &tok_temp2) != 0) {
       return -1;
     }
 
     //Depending on the type of token, get the values of from them and assign it to temporary variables
-    if(tok_temp1->type == TYPE_VALUE) {
-      temp1 = tok_temp1->value;
-    }
-    if(tok_temp1->type == TYPE_VARIABLE) {
-      Symbol *temp_symbol1 = hash_get(symtab, tok_temp1->variable);
-      temp1 = temp_symbol1->val;
-      symbol_free(temp_symbol1);
-      temp_symbol1 = NULL;
-    }
-    if(tok_temp2->type == TYPE_VALUE) {
-      temp2 = tok_temp2->value;
-    }
-    if(tok_temp2->type == TYPE_VARIABLE) {
-      Symbol *temp_symbol2 = hash_get(symtab, tok_temp2->variable);
-      temp2 = temp_symbol2->val;
-      symbol_free(temp_symbol2);
-      temp_symbol2 = NULL;
+    if (get_operand_value(symtab, &tok_temp1, &temp1) != 0 ||
+        get_operand_value(symtab, &tok_temp2, &temp2) != 0) {
+      return -1;
     }
 
     //Switch case for the type of operation
@@ -196,6 +794,9 @@ static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok) {
       break;
 
     case OPERATOR_DIV:
+      if (temp1 == 0) {
+        return -1;
+      }
       temp3 = temp2 / temp1;
       break;
 
@@ -203,69 +804,36 @@ static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok) {
       return -1;
     }
 
-    //Create a token with the answer value
-    tok_temp3 = token_create_value(temp3);
+    STATS_INC(opers[tok->oper]);
 
-    if (tok_temp3 == NULL) {
-      return -1;
-    }
-    //Push this new token on the stack
-    flag = stack_push(stack, tok_temp3);
+    //Push a value token with the answer on the stack
+    tok_temp.type = TYPE_VALUE;
+    tok_temp.value = temp3;
+    flag = stack_push_value(stack, &tok_temp);
 
     if (flag == -1) {
       return -1;
     }
-
-    token_free(tok_temp1);
-    tok_temp1 = NULL;
-    token_free(tok_temp2);
-    tok_temp2 = NULL;
-    token_free(tok);
-    tok = NULL;
     break;
 
   case TYPE_VARIABLE:
-    //Push this variable on the stack
-    flag = stack_push(stack, tok);
-    if (flag != 0) {
-      return -1;
-    }
-    break;
-
   case TYPE_VALUE:
-    //Push this value on the stack
-    flag = stack_push(stack, tok);
+    //Push this variable or value on the stack (the stack keeps a copy)
+    flag = stack_push_value(stack, tok);
     if (flag != 0) {
       return -1;
     }
     break;
 
   case TYPE_PRINT:
-    tok_temp = stack_pop(stack);
-
-    if (tok_temp == NULL) {
+    if (stack_pop_value(stack, &tok_temp) != 0) {
       return -1;
     }
-    //If the popped token is just a value, print it as it is
-    if (tok_temp->type == TYPE_VALUE) {
-      print_step_output(tok_temp->value);
-    }
-    //If the popped token is a variable, get its value from hash table and print it
-    if (tok_temp->type == TYPE_VARIABLE) {
-      Symbol * temp_sym = hash_get(symtab, tok_temp->variable);
-      
-      if (temp_sym == NULL) {
-        return -1;
-      }
-
-      print_step_output(temp_sym->val);
-      symbol_free(temp_sym);
-      temp_sym = NULL;
+    //Print the popped value, getting it from hash table if it is a variable
+    if (get_operand_value(symtab, &tok_temp, &temp1) != 0) {
+      return -1;
     }
-
-    token_free(tok_temp);
-    tok_temp = NULL;
-    token_free(tok);
+    print_step_output(out, trace, temp1);
     break;
 
   default:
@@ -277,33 +845,53 @@ static int parse_token(Symtab *symtab, Stack_head *stack, Token *tok) {
 
 /* Prints out the main output header
  */
-static void print_header(char *filename, int step) {
-  printf("######### Beginning Program (%s) ###########\n", filename);
-  printf("\n.-------------------\n");
-  printf("| Program Step = %2d\n", step);
-  token_print_remaining();
-  printf("o-------------------\n");
+static void print_header(Outbuf *out, Token_ctx *ctx, char *filename, int step) {
+  outbuf_str(out, "######### Beginning Program (");
+  outbuf_str(out, filename);
+  outbuf_str(out, ") ###########\n");
+  print_step_header(out, step);
+  token_ctx_write_remaining(ctx, out);
+  outbuf_str(out, "o-------------------\n");
 }
 
 /* Prints out the information at the top of each step
  */
-static void print_step_header(int step) {
-  printf("\n.-------------------\n");
-  printf("| Program Step = %2d\n", step++);
+static void print_step_header(Outbuf *out, int step) {
+  outbuf_str(out, "\n.-------------------\n");
+  outbuf_str(out, "| Program Step = ");
+  outbuf_int_pad(out, step, 2);
+  outbuf_write(out, "\n", 1);
 }
 
 /* Prints out the output value (print token) nicely
+ * With TRACE_QUIET only the value itself is printed.
  */
-static void print_step_output(int val) {
-  printf("|-----Program Output\n");
-  printf("| %d\n", val);
+static void print_step_output(Outbuf *out, int trace, int val) {
+  if(trace == TRACE_QUIET) {
+    outbuf_int(out, val);
+    outbuf_write(out, "\n", 1);
+    return;
+  }
+  outbuf_str(out, "|-----Program Output\n");
+  outbuf_write(out, "| ", 2);
+  outbuf_int(out, val);
+  outbuf_write(out, "\n", 1);
+}
+
+/* Prints out each output value of a compiled program (see program_run)
+ * arg points at the Output to print to.
+ */
+static void emit_output(void *arg, int val) {
+  Output *output = arg;
+
+  print_step_output(output->out, output->trace, val);
 }
 
 /* Prints out the information at the bottom of each step
  */
-static void print_step_footer(Symtab *symtab, Stack_head *stack) {
-  hash_print_symtab(symtab);
-  stack_print(stack);
-  token_print_remaining();
-  printf("o-------------------\n");
-}
\ No newline at end of file
+static void print_step_footer(Outbuf *out, Token_ctx *ctx, Symtab *symtab, Stack_head *stack) {
+  hash_write_symtab(symtab, out);
+  stack_write(stack, out);
+  token_ctx_write_remaining(ctx, out);
+  outbuf_str(out, "o-------------------\n");
+}
@@ -3,7 +3,43 @@
 
 #include "stack.h"
 #include "hash.h"
+#include "outbuf.h"
+#include "cache.h"
+
+/* Trace levels
+ * TRACE_QUIET prints nothing but the value of each print token, one per line
+ * TRACE_SAMPLED prints the full trace of every sample'th step only
+ * TRACE_FULL prints the full trace of every step
+ */
+#define TRACE_QUIET   0
+#define TRACE_SAMPLED 1
+#define TRACE_FULL    2
+
+/* Options for running a program with rpn_run
+ * trace is one of the TRACE_ levels and sample the step interval used by
+ * -- TRACE_SAMPLED
+ * compiled runs the program through the bytecode compiler, which has no
+ * -- per step trace, and optimize is the program_optimize flags it uses
+ * out is where all of the output is written (NULL for stdout)
+ * cache, if not NULL, holds compiled programs for reuse by later compiled
+ * -- runs of the same source (it may be shared by several threads)
+ * parallel is the number of threads a compiled program may use to run its
+ * -- independent subexpressions at once (see par_run; 0 or 1 for none)
+ */
+typedef struct rpn_options_struct {
+  int trace;
+  int sample;
+  int compiled;
+  int optimize;
+  Outbuf *out;
+  Program_cache *cache;
+  int parallel;
+} Rpn_options;
 
 int rpn(Stack_head *stack, Symtab *symtab, char *filename);
+int rpn_run(Stack_head *stack, Symtab *symtab, char *filename, Rpn_options *opts);
+int rpn_columns(char *filename, char *bindings, Rpn_options *opts);
+int rpn_stream(Stack_head *stack, Symtab *symtab, int fd, Rpn_options *opts);
+int rpn_eval(Stack_head *stack, Symtab *symtab, char *source, int len, Rpn_options *opts);
 
 #endif
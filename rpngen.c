@@ -0,0 +1,40 @@
+/* Writes a synthetic RPN program to stdout, for benchmarks and testing.
+ *
+ * Usage: rpngen [-n tokens] [-v vars] [-m +,-,*,/] [-a assign_pct]
+ *               [-d depth] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gen.h"
+
+/* Prints how to run the generator */
+static void usage(char *name) {
+  printf("Usage: %s [-n tokens] [-v vars] [-m +,-,*,/] [-a assign_pct] [-d depth] [-s seed]\n", name);
+  printf("  -n N  number of tokens to write (default %d)\n", GEN_TOKENS);
+  printf("  -v N  number of distinct variables (default %d)\n", GEN_VARS);
+  printf("  -m W  weights of the four operators, eg. 4,4,1,1 (default 1,1,1,1)\n");
+  printf("  -a P  percentage of statements that are assignments (default %d)\n", GEN_ASSIGN_PCT);
+  printf("  -d N  deepest expression tree (default %d)\n", GEN_DEPTH);
+  printf("  -s N  random seed; the same options always give the same program\n");
+}
+
+int main(int argc, char *argv[]) {
+  Gen_options opts;
+  int i = 0;
+
+  gen_default_options(&opts);
+  for(i = 1; i < argc; i++) {
+    if(i + 1 >= argc || gen_parse_option(&opts, argv[i], argv[i + 1]) != 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+  }
+
+  if(gen_program(&opts, stdout) < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,288 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "stack.h"
+#include "hash.h"
+#include "outbuf.h"
+#include "snapshot.h"
+
+/* One client connection, owned by the thread serving it.
+ * base is the snapshot shared by every connection, or NULL
+ */
+typedef struct server_conn_struct {
+  int fd;
+  int kind;
+  Symtab *base;
+  Rpn_options *opts;
+  Server_stats *stats;
+} Server_conn;
+
+/* Set by the signal handler once the server should stop accepting */
+static volatile sig_atomic_t server_stopping = 0;
+
+/* Local Function Declarations */
+static void server_stop(int sig);
+static void *server_connection(void *arg);
+static int server_request(Server_conn *conn, Stack_head *stack, Symtab *symtab, Outbuf *out,
+                          char *line, int len);
+static long server_elapsed_us(struct timespec *start);
+
+/* Serves RPN programs on a Unix domain socket at path until SIGINT or
+ *   SIGTERM.
+ * The protocol is one program per line.  For each line the reply is the
+ *   value of every print token, one per line, then "ok N" or (after the
+ *   usual error message) "error N", where N is how long the program took
+ *   in microseconds.  A client may send any number of lines without
+ *   waiting; replies come back in order, and are flushed each time every
+ *   line read so far has been answered.
+ * Each connection has its own thread and its own Stack and Symbol Table
+ *   (of the given kind), which are cleared, not freed, between requests:
+ *   every request starts from an empty Symbol Table.  If snapshot is not
+ *   NULL it is loaded once and every Symbol Table is an overlay of it
+ *   instead (see hash_initialize_overlay), so every request starts from
+ *   the snapshot's variables and clearing only drops what it wrote.
+ * opts says how programs are run (opts->out is not used); its cache, if
+ *   any, is shared by every connection.
+ * Returns 0 once stopped, or -1 if the snapshot could not be loaded or
+ *   the socket could not be set up.
+ */
+int server_run(char *path, int kind, char *snapshot, Rpn_options *opts) {
+  struct sockaddr_un addr;
+  struct sigaction action;
+  struct stat st;
+  Server_stats stats;
+  Symtab *base = NULL;
+  Server_conn *conn = NULL;
+  struct timespec backoff = { 0, SERVER_ACCEPT_BACKOFF_MS * 1000000L };
+  sigset_t stop_signals;
+  sigset_t old_mask;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int listener = -1;
+  int fd = -1;
+
+  if(path == NULL || opts == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+
+  if(snapshot != NULL && (base = snapshot_load(snapshot)) == NULL) {
+    return -1;
+  }
+
+  //Only ever replace a stale socket, never some other file
+  if(stat(path, &st) == 0) {
+    if(!S_ISSOCK(st.st_mode) || unlink(path) != 0) {
+      hash_destroy(base);
+      return -1;
+    }
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listener < 0) {
+    hash_destroy(base);
+    return -1;
+  }
+  if(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+     listen(listener, SERVER_BACKLOG) != 0) {
+    close(listener);
+    hash_destroy(base);
+    return -1;
+  }
+
+  //Stop on SIGINT or SIGTERM by interrupting accept; a client that goes
+  //away mid reply must not kill the server with SIGPIPE
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = server_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  action.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &action, NULL);
+  //Connection threads block the stop signals, so they always land here
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+
+  memset(&stats, 0, sizeof(stats));
+  pthread_mutex_init(&stats.lock, NULL);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  fprintf(stderr, "Serving on %s\n", path);
+
+  while(!server_stopping) {
+    fd = accept(listener, NULL, NULL);
+    if(fd < 0) {
+      //Anything but a signal or a client giving up will not clear at once,
+      //so wait a little rather than spin on it
+      if(errno != EINTR && errno != ECONNABORTED) {
+        fprintf(stderr, "Warning: Cannot Accept on %s: %s\n", path, strerror(errno));
+        nanosleep(&backoff, NULL);
+      }
+      continue;
+    }
+    conn = malloc(sizeof(Server_conn));
+    if(conn != NULL) {
+      conn->fd = fd;
+      conn->kind = kind;
+      conn->base = base;
+      conn->opts = opts;
+      conn->stats = &stats;
+    }
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    if(conn == NULL || pthread_create(&thread, &attr, server_connection, conn) != 0) {
+      free(conn);
+      close(fd);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  }
+
+  close(listener);
+  unlink(path);
+  pthread_attr_destroy(&attr);
+
+  pthread_mutex_lock(&stats.lock);
+  fprintf(stderr, "Served %ld requests (%ld failed), mean %.1f us, max %ld us\n",
+          stats.requests, stats.failed,
+          (stats.requests > 0) ? (double)stats.total_us / stats.requests : 0.0, stats.max_us);
+  pthread_mutex_unlock(&stats.lock);
+  //Connections still open end with the process, so stats and base are
+  //never freed
+  return 0;
+}
+
+/* Local function to ask the accept loop to stop (the signal handler) */
+static void server_stop(int sig) {
+  (void)sig;
+  server_stopping = 1;
+}
+
+/* Local function serving one connection until the client closes it.
+ * Requests are answered straight out of the read buffer; a partial line
+ *   at the end is kept for the next read.
+ */
+static void *server_connection(void *arg) {
+  Server_conn *conn = arg;
+  Stack_head *stack = stack_initialize();
+  Symtab *symtab = (conn->base != NULL) ? hash_initialize_overlay(conn->base) : hash_initialize_kind(conn->kind);
+  Outbuf *out = outbuf_initialize(conn->fd);
+  char *buf = malloc(SERVER_READ_LEN);
+  char *bigger = NULL;
+  int capacity = SERVER_READ_LEN;
+  int len = 0;
+  int start = 0;
+  int scan = 0;
+  int n = 0;
+  int open = (stack != NULL && symtab != NULL && out != NULL && buf != NULL);
+
+  while(open) {
+    //Make room for more (and a NUL), growing only for a very long line
+    if(len >= capacity - 1) {
+      bigger = (capacity < SERVER_MAX_REQUEST) ? realloc(buf, capacity * 2) : NULL;
+      if(bigger == NULL) {
+        outbuf_str(out, "error 0\n");
+        outbuf_flush(out);
+        break;
+      }
+      buf = bigger;
+      capacity *= 2;
+    }
+    n = read(conn->fd, buf + len, capacity - 1 - len);
+    if(n < 0 && errno == EINTR) {
+      continue;
+    }
+    if(n <= 0) {
+      //A last request without its newline still gets an answer
+      if(len > start) {
+        buf[len] = '\0';
+        server_request(conn, stack, symtab, out, buf + start, len - start);
+      }
+      break;
+    }
+    len += n;
+
+    //Answer every complete line read so far
+    for(; scan < len; scan++) {
+      if(buf[scan] == '\n') {
+        buf[scan] = '\0';
+        server_request(conn, stack, symtab, out, buf + start, scan - start);
+        start = scan + 1;
+      }
+    }
+    outbuf_flush(out);
+    open = !out->error;
+
+    //Keep the partial line, at the front of the buffer
+    memmove(buf, buf + start, len - start);
+    len -= start;
+    scan -= start;
+    start = 0;
+  }
+
+  outbuf_destroy(out);
+  close(conn->fd);
+  free(buf);
+  stack_destroy(stack);
+  hash_destroy(symtab);
+  free(conn);
+  return NULL;
+}
+
+/* Local function to answer one request line of len bytes (NUL
+ *   terminated) into out, then clear stack and symtab for the next one.
+ * Returns the result of rpn_eval.
+ */
+static int server_request(Server_conn *conn, Stack_head *stack, Symtab *symtab, Outbuf *out,
+                          char *line, int len) {
+  Rpn_options opts = *conn->opts;
+  Server_stats *stats = conn->stats;
+  struct timespec start;
+  long us = 0;
+  int ret = 0;
+
+  //Lines may end in \r\n
+  if(len > 0 && line[len - 1] == '\r') {
+    line[--len] = '\0';
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  opts.out = out;
+  ret = rpn_eval(stack, symtab, line, len, &opts);
+  us = server_elapsed_us(&start);
+
+  outbuf_str(out, (ret == 0) ? "ok " : "error ");
+  outbuf_int(out, (int)us);
+  outbuf_write(out, "\n", 1);
+
+  stack_clear(stack);
+  hash_clear(symtab);
+
+  pthread_mutex_lock(&stats->lock);
+  stats->requests++;
+  stats->failed += (ret != 0);
+  stats->total_us += us;
+  stats->max_us = (us > stats->max_us) ? us : stats->max_us;
+  pthread_mutex_unlock(&stats->lock);
+  return ret;
+}
+
+/* Local function returning the microseconds since start */
+static long server_elapsed_us(struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
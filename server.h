@@ -0,0 +1,37 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+
+#include "rpn.h"
+
+/* Pending connections the listening socket holds before accept */
+#define SERVER_BACKLOG 64
+
+/* Starting size of a connection's request buffer, which doubles as needed */
+#define SERVER_READ_LEN 65536
+
+/* Longest request line a connection may send before it is dropped */
+#define SERVER_MAX_REQUEST (16 * 1024 * 1024)
+
+/* How long to wait before accepting again after accept fails for a reason
+ * that will not go away at once, such as running out of descriptors */
+#define SERVER_ACCEPT_BACKOFF_MS 100
+
+/* Server Statistics
+ * Totals over every request the server has answered, guarded by lock.
+ * requests counts them, failed those that ended in an error
+ * total_us and max_us are the sum and the worst of their latencies
+ */
+typedef struct server_stats_struct {
+  long requests;
+  long failed;
+  long long total_us;
+  long max_us;
+  pthread_mutex_t lock;
+} Server_stats;
+
+/* Server Function Prototypes */
+int server_run(char *path, int kind, char *snapshot, Rpn_options *opts);
+
+#endif
@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "hash.h"
+#include "oahash.h"
+#include "ctab.h"
+
+/* Local Function Declarations */
+static int snapshot_put_all(Symtab *flat, Symtab *symtab);
+static int snapshot_put_chain(Symtab *flat, Symbol *walker);
+static int snapshot_check_slots(Symbol *slots, int capacity, int size);
+
+/* Writes every Symbol in symtab (of any kind, or an overlay along with
+ *   its base) to path as a snapshot.
+ * The Symbols are laid out in a fresh HASH_OPEN table that is at most half
+ *   full, so a loaded snapshot takes at least one more Symbol before it
+ *   has to grow.  The file is written beside path and then renamed over
+ *   it, so a reader never sees half of it.
+ * Returns 0 on success, or -1 on any memory or file errors.
+ */
+int snapshot_save(Symtab *symtab, char *path) {
+  Snapshot_header header;
+  Symtab *flat = NULL;
+  FILE *fp = NULL;
+  char *tmp = NULL;
+  int ok = 1;
+
+  if(symtab == NULL || path == NULL) {
+    return -1;
+  }
+  flat = hash_initialize_kind(HASH_OPEN);
+  if(flat == NULL) {
+    return -1;
+  }
+  hash_rehash(flat, hash_get_size(symtab) * 2 + 2);
+  ok = (snapshot_put_all(flat, symtab) == 0);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.version = SNAPSHOT_VERSION;
+  header.symbol_size = sizeof(Symbol);
+  header.size = flat->size;
+  header.capacity = flat->capacity;
+
+  tmp = malloc(strlen(path) + 5);
+  if(ok && tmp != NULL) {
+    sprintf(tmp, "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+  }
+  if(fp == NULL) {
+    free(tmp);
+    hash_destroy(flat);
+    return -1;
+  }
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+       fwrite(flat->slots, sizeof(Symbol), flat->capacity, fp) == (size_t)flat->capacity;
+  if(fclose(fp) != 0) {
+    ok = 0;
+  }
+  if(ok && rename(tmp, path) != 0) {
+    ok = 0;
+  }
+  if(!ok) {
+    remove(tmp);
+  }
+  free(tmp);
+  hash_destroy(flat);
+  return ok ? 0 : -1;
+}
+
+/* Local function to put every Symbol of symtab into flat, from whichever
+ *   table it lives in.  An overlay's base goes first, so the overlay's own
+ *   values win.
+ * Returns 0 on success, or -1 on any memory errors.
+ */
+static int snapshot_put_all(Symtab *flat, Symtab *symtab) {
+  Ctab_table *table = NULL;
+  Symbol *sym = NULL;
+  int ok = 1;
+  int i = 0;
+
+  if(symtab->base != NULL) {
+    ok = (snapshot_put_all(flat, symtab->base) == 0);
+  }
+  if(symtab->kind == HASH_OPEN) {
+    for(i = 0; ok && i < symtab->capacity; i++) {
+      if(symtab->slots[i].variable[0] != '\0') {
+        ok = (hash_put(flat, symtab->slots[i].variable, symtab->slots[i].val) == 0);
+      }
+    }
+  }
+  else if(symtab->kind == HASH_CONCURRENT) {
+    table = __atomic_load_n(&(symtab->ctab->table), __ATOMIC_ACQUIRE);
+    for(i = 0; ok && i < table->capacity; i++) {
+      sym = __atomic_load_n(&(table->slots[i]), __ATOMIC_ACQUIRE);
+      if(sym != NULL) {
+        ok = (hash_put(flat, sym->variable, ctab_get_value(sym)) == 0);
+      }
+    }
+  }
+  else {
+    for(i = 0; ok && i < symtab->capacity; i++) {
+      ok = (snapshot_put_chain(flat, symtab->table[i]) == 0);
+    }
+    for(i = symtab->migrate; ok && symtab->old_table != NULL && i < symtab->old_capacity; i++) {
+      ok = (snapshot_put_chain(flat, symtab->old_table[i]) == 0);
+    }
+  }
+  return ok ? 0 : -1;
+}
+
+/* Local function to hash_put every Symbol of one chain into flat */
+static int snapshot_put_chain(Symtab *flat, Symbol *walker) {
+  while(walker != NULL) {
+    if(hash_put(flat, walker->variable, walker->val) != 0) {
+      return -1;
+    }
+    walker = walker->next;
+  }
+  return 0;
+}
+
+/* Local function to check the slots of a mapped snapshot before they are
+ *   probed: every name must end within its slot, and exactly size slots
+ *   may be in use so a probe for a missing name always finds an empty one.
+ * Returns 0 if the slots are sound, or -1 if not.
+ */
+static int snapshot_check_slots(Symbol *slots, int capacity, int size) {
+  int used = 0;
+  int i = 0;
+
+  for(i = 0; i < capacity; i++) {
+    if(slots[i].variable[0] == '\0') {
+      continue;
+    }
+    if(memchr(slots[i].variable, '\0', MAX_VAR_LEN) == NULL) {
+      return -1;
+    }
+    used++;
+  }
+  return (used == size) ? 0 : -1;
+}
+
+/* Loads a snapshot written by snapshot_save as a HASH_OPEN Symtab.
+ * The slots are mapped straight from the file (privately) and nothing is
+ *   hashed up front.  Updates are copy on write and never reach the file;
+ *   a put that grows the table moves it onto the heap.
+ * The header and every slot are checked, so a truncated or corrupt file
+ *   is refused rather than probed.
+ * Returns NULL on any file or memory errors, or if path is not a snapshot.
+ */
+Symtab *snapshot_load(char *path) {
+  Snapshot_header header;
+  struct stat st;
+  Symtab *symtab = NULL;
+  void *map = MAP_FAILED;
+  int fd = -1;
+
+  if(path == NULL) {
+    return NULL;
+  }
+  fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return NULL;
+  }
+  if(fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != sizeof(header) ||
+     memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+     header.version != SNAPSHOT_VERSION || header.symbol_size != sizeof(Symbol) ||
+     header.capacity <= 0 || hash_round_capacity(header.capacity) != header.capacity ||
+     header.size < 0 || header.size >= header.capacity ||
+     st.st_size != (off_t)(sizeof(header) + sizeof(Symbol) * (size_t)header.capacity)) {
+    close(fd);
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    return NULL;
+  }
+  if(snapshot_check_slots((Symbol *)((char *)map + sizeof(header)), header.capacity, header.size) != 0) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  symtab = hash_initialize_kind(HASH_OPEN);
+  if(symtab == NULL) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  //Swap the empty slot array for the mapped one
+  oahash_destroy(symtab);
+  symtab->map = map;
+  symtab->map_len = st.st_size;
+  symtab->slots = (Symbol *)((char *)map + sizeof(header));
+  symtab->size = header.size;
+  symtab->capacity = header.capacity;
+  return symtab;
+}
@@ -0,0 +1,29 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "symbol.h"
+
+/* First bytes of a snapshot file, and its format version */
+#define SNAPSHOT_MAGIC   "RPNSYMS"
+#define SNAPSHOT_VERSION 1
+
+/* Snapshot File Header
+ * A snapshot is this header followed by the capacity slots of a HASH_OPEN
+ * table, exactly as they sit in memory, so loading one is a single mmap.
+ * symbol_size is sizeof(Symbol) on the machine that wrote it; a snapshot
+ * -- is only ever read back on the same kind of machine
+ * size is the number of Symbols in the capacity (a power of two) slots
+ */
+typedef struct snapshot_header_struct {
+  char magic[8];
+  int version;
+  int symbol_size;
+  int size;
+  int capacity;
+} Snapshot_header;
+
+/* Snapshot Function Prototypes */
+int snapshot_save(Symtab *symtab, char *path);
+Symtab *snapshot_load(char *path);
+
+#endif
@@ -1,8 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "node.h"
 #include "stack.h"
+#include "stats.h"
 
 /* Create a new Stack_head struct on the Heap and return a pointer to it.
  * On any malloc errors, return NULL
@@ -14,12 +14,17 @@ Stack_head *stack_initialize() {
   if(head == NULL) {
     return NULL;
   }
-  //Set the default values for Stack head and return it
-  else {
-    head->count = 0;
-    head->top = NULL;
-    return head;
+  //Initialize the operand array from heap
+  head->items = malloc(sizeof(Token) * STACK_INITIAL);
+
+  if(head->items == NULL) {
+    free(head);
+    return NULL;
   }
+  //Set the default values for Stack head and return it
+  head->count = 0;
+  head->capacity = STACK_INITIAL;
+  return head;
 }
 
 /* Destroys the stack.
@@ -27,87 +32,116 @@ Stack_head *stack_initialize() {
  */
 void stack_destroy(Stack_head *head) {
 
-  Node *temp = NULL;
-  
   if(head == NULL) {
     return;
   }
-  //Iterate through each node (temp) and its token (head->top->tok) and free them
-  while (head->top != NULL) {
-    temp = head->top;
-    token_free(head->top->tok);
-    head->top = head->top->next;
-    node_free(temp);
-  }
+  //The operands live inside items, so freeing the array frees them all
+  free(head->items);
+  head->items = NULL;
   //free the head struct itself
   free(head);
   head = NULL;
   return;
 }
 
-/* Push a new Token on to the Stack.
+/* Doubles the room in the operand array.
+ * On any realloc errors, return -1 and leave the stack as it was.
+ */
+static int stack_grow(Stack_head *stack) {
+  Token *items = realloc(stack->items, sizeof(Token) * stack->capacity * 2);
+
+  if(items == NULL) {
+    return -1;
+  }
+
+  stack->items = items;
+  stack->capacity *= 2;
+  return 0;
+}
+
+/* Push a copy of a Token on to the Stack.  The caller keeps tok.
  * On any malloc errors, return -1.
  * If there are no errors, return 0.
  */
-int stack_push(Stack_head *stack, Token *tok) {
-  
-  Node *temp_node = NULL;
+int stack_push_value(Stack_head *stack, Token *tok) {
 
   if((stack == NULL) || (tok == NULL)) {
     return -1;
   }
-  //Create a new node (temp_node) with the token (tok)
-  else {
-    temp_node = node_create(tok);
-
-    if(temp_node == NULL){
-      return -1;
-    }
-    //Attach temp_node at the top of the stack and increase the stack size
-    else{
-      temp_node->next = stack->top;
-      stack->top = temp_node;
-      (stack->count)++;
-      temp_node = NULL;
-      return 0;
-    }
+  //Make room for one more operand if the array is full
+  if(stack->count == stack->capacity && stack_grow(stack) != 0) {
+    return -1;
+  }
+
+  stack->items[stack->count] = *tok;
+  (stack->count)++;
+  STATS_MAX(max_stack_depth, stack->count);
+  return 0;
+}
+
+/* Pop the top Token off of the Stack into out.
+ * If the stack was empty, return -1.
+ * Otherwise, return 0.
+ */
+int stack_pop_value(Stack_head *stack, Token *out) {
+
+  if((stack == NULL) || (out == NULL) || (stack->count == 0)) {
+    return -1;
+  }
+
+  (stack->count)--;
+  *out = stack->items[stack->count];
+  return 0;
+}
+
+/* Push a new Token on to the Stack.
+ * The stack takes ownership of tok: it is copied in and then freed.
+ * On any malloc errors, return -1 (tok is left with the caller).
+ * If there are no errors, return 0.
+ */
+int stack_push(Stack_head *stack, Token *tok) {
+
+  if(stack_push_value(stack, tok) != 0) {
+    return -1;
   }
+
+  token_free(tok);
+  return 0;
 }
 
-/* Pop a Token off of the Stack.
- * If the stack was empty, return NULL.
+/* Pop a Token off of the Stack.  The caller must token_free it.
+ * If the stack was empty or there are any malloc errors, return NULL.
  */
 Token *stack_pop(Stack_head *stack) {
 
   Token *temp_token = NULL;
-  Node *temp_node = NULL;
-  
-  if ((stack == NULL) || (stack->top == NULL)) {
+
+  if((stack == NULL) || (stack->count == 0)) {
     return NULL;
   }
-  //Store the actual top node and token in temp variables and after head->top is updated, free node and return token. Also reduce stack size.
-  else {
-    temp_token = stack->top->tok;
-    temp_node = stack->top;
-    stack->top = stack->top->next;
-    (stack->count)--;
-    node_free(temp_node);
-    temp_node = NULL;
-    return temp_token;
+
+  temp_token = malloc(sizeof(Token));
+  if(temp_token == NULL) {
+    return NULL;
   }
+
+  stack_pop_value(stack, temp_token);
+  return temp_token;
 }
 
-/* Return the token in the stack node on the top of the stack
+/* Return the token on the top of the stack.
+ * The token still belongs to the stack and is only valid until the next
+ *   push or pop.
  * If the stack is NULL, return NULL.
  * If the stack is empty, return NULL.
  */
 Token *stack_peek(Stack_head *stack) {
 
-  if((stack == NULL) || (stack->top == NULL)) {
+  if((stack == NULL) || (stack->count == 0)) {
     return NULL;
   }
   else {
-    return (stack->top->tok);
+    return &(stack->items[stack->count - 1]);
   }
 }
 
@@ -129,33 +163,43 @@ int stack_is_empty(Stack_head *stack) {
   }
 }
 
-/* It recurses the stack and prints out the tokens in reverse order
- * eg. top->2->4->1->8 will print at Stack: 8 1 4 2
- * eg. stack_push(5) will then print Stack: 8 1 4 2 5
+/* Empties the stack, keeping its items array so it can be used again
+ *   without allocating.
  */
+void stack_clear(Stack_head *stack) {
+  if(stack == NULL) {
+    return;
+  }
+  stack->count = 0;
+}
 
-/* Recursive print. (Local function)
- * Base Case: node == NULL, return
- * Recursive Case: call print_node(node->next, print_data), then print node.
+/* Prints out the tokens from the top of the stack down to the bottom
+ * eg. pushing 8, 1, 4 and then 2 will print Stack: 2 4 1 8
  */
-static void print_node(Node *node) {
-  if(node == NULL) {
+void stack_print(Stack_head *stack) {
+  Outbuf *out = NULL;
+
+  if(stack == NULL) {
     return;
   }
-  token_print(node->tok);
-  print_node(node->next);
-  return;
+  out = outbuf_initialize(OUTBUF_MEMORY);
+  stack_write(stack, out);
+  outbuf_print_stdout(out);
+  outbuf_destroy(out);
 }
 
-/* Setup function for the recursive calls.  Starts printing with stack->top
+/* Writes the stack to out, in the same form as stack_print
  */
-void stack_print(Stack_head *stack) {
+void stack_write(Stack_head *stack, Outbuf *out) {
+  int i = 0;
+
   if(stack == NULL) {
     return;
   }
-  printf("|-----Program Stack\n");
-  printf("| ");
-  print_node(stack->top);
-  printf("\n");
-  return;
-}
\ No newline at end of file
+  outbuf_str(out, "|-----Program Stack\n");
+  outbuf_write(out, "| ", 2);
+  for(i = stack->count - 1; i >= 0; i--) {
+    token_write(&(stack->items[i]), out);
+  }
+  outbuf_write(out, "\n", 1);
+}
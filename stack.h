@@ -6,11 +6,21 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "node.h"
+#include "token.h"
 
+#define STACK_INITIAL 16
+
+/* Stack Structure
+ * The stack is a growable array that holds its operands inline.
+ * count is the number of operands on the stack (items[count - 1] is the top)
+ * capacity is the number of operands items has room for
+ * items is the array of operands; it only ever grows, so pushes and pops
+ * -- never allocate once the stack has reached its working depth.
+ */
 typedef struct stack_head_struct {
   int count;
-  Node *top;
+  int capacity;
+  Token *items;
 } Stack_head;
 
 /* Function Declaration Prototypes */
@@ -19,7 +29,11 @@ void stack_destroy(Stack_head *head);
 int stack_push(Stack_head *stack, Token *tok);
 Token *stack_pop(Stack_head *stack);
 Token *stack_peek(Stack_head *stack);
+int stack_push_value(Stack_head *stack, Token *tok);
+int stack_pop_value(Stack_head *stack, Token *out);
 int stack_is_empty(Stack_head *stack);
+void stack_clear(Stack_head *stack);
 void stack_print(Stack_head *stack);
+void stack_write(Stack_head *stack, Outbuf *out);
 
 #endif
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+#ifdef RPN_STATS
+
+__thread Rpn_stats rpn_stats;
+
+/* The real allocator, under the names given to it by -Wl,--wrap */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  rpn_stats.allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  rpn_stats.allocs++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  rpn_stats.allocs++;
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+  if(ptr != NULL) {
+    rpn_stats.frees++;
+  }
+  __real_free(ptr);
+}
+
+/* Returns the current time in nanoseconds */
+double stats_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Adds the time since start to the time spent rehashing */
+void stats_rehash_time(double start) {
+  double ns = stats_now_ns() - start;
+
+  rpn_stats.rehash_ns += ns;
+  if(ns > rpn_stats.rehash_max_ns) {
+    rpn_stats.rehash_max_ns = ns;
+  }
+}
+
+/* Prints this thread's statistics as one line of JSON.
+ * filename is the program they were gathered running.
+ */
+void stats_print_json(FILE *out, char *filename) {
+  Rpn_stats *s = &rpn_stats;
+
+  //One fprintf, so lines from different threads never interleave
+  fprintf(out, "{\"stats\": {\"program\": \"%s\", "
+          "\"tokens\": {\"assignment\": %ld, \"operator\": %ld, \"variable\": %ld, \"value\": %ld, \"print\": %ld}, "
+          "\"operators\": {\"+\": %ld, \"-\": %ld, \"*\": %ld, \"/\": %ld}, "
+          "\"opcodes\": {\"push\": %ld, \"load\": %ld, \"store\": %ld, \"add\": %ld, \"sub\": %ld, "
+          "\"mul\": %ld, \"div\": %ld, \"print\": %ld}, "
+          "\"hash\": {\"puts\": %ld, \"lookups\": %ld, \"chain_steps\": %ld, \"probe_steps\": %ld, "
+          "\"rehashes\": %ld, \"rehash_ns\": %.0f, \"rehash_max_ns\": %.0f}, "
+          "\"stack\": {\"max_depth\": %ld}, "
+          "\"memory\": {\"allocs\": %ld, \"frees\": %ld}}}\n",
+          filename,
+          s->tokens[0], s->tokens[1], s->tokens[2], s->tokens[3], s->tokens[4],
+          s->opers[0], s->opers[1], s->opers[2], s->opers[3],
+          s->opcodes[0], s->opcodes[1], s->opcodes[2], s->opcodes[3],
+          s->opcodes[4], s->opcodes[5], s->opcodes[6], s->opcodes[7],
+          s->hash_puts, s->hash_lookups, s->chain_steps, s->probe_steps,
+          s->rehashes, s->rehash_ns, s->rehash_max_ns,
+          s->max_stack_depth, s->allocs, s->frees);
+}
+
+/* Clears this thread's statistics */
+void stats_reset() {
+  memset(&rpn_stats, 0, sizeof(rpn_stats));
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* Hot path statistics, only compiled in when RPN_STATS is defined
+ * (see the calc_stats target in the Makefile).  Without it every STATS_
+ * macro expands to nothing, so the instrumented code is unchanged.
+ *
+ * The counters are per thread, so batch workers never share them.
+ * rpn_run prints them as one line of JSON on stderr when a program ends
+ * and then clears them, so each line covers exactly one program.
+ * Symbol pools keep their own counters; hash_destroy prints them on
+ * stderr with STATS_POOL when a table goes away.
+ */
+
+#ifdef RPN_STATS
+
+/* Number of token types, operators and opcodes counted */
+#define STATS_TYPES   5
+#define STATS_OPERS   4
+#define STATS_OPCODES 8
+
+/* Statistics Structure
+ * tokens counts parse_token calls by TYPE_, opers counts operator tokens
+ * -- by OPERATOR_ and opcodes counts compiled instructions run by OP_
+ * hash_puts and hash_lookups count calls (hash_get, hash_get_value and
+ * -- hash_update all look up)
+ * chain_steps and probe_steps count the Symbols compared while walking
+ * -- chains and probing slots
+ * rehashes counts rehashes started; rehash_ns is the time spent in them
+ * -- (including the incremental migration of chains) and rehash_max_ns the
+ * -- longest single call spent rehashing
+ * max_stack_depth is the deepest the operand stack got
+ * allocs counts malloc, calloc and realloc calls and frees non-NULL frees
+ * -- (counted by wrapping them at link time)
+ */
+typedef struct rpn_stats_struct {
+  long tokens[STATS_TYPES];
+  long opers[STATS_OPERS];
+  long opcodes[STATS_OPCODES];
+  long hash_puts;
+  long hash_lookups;
+  long chain_steps;
+  long probe_steps;
+  long rehashes;
+  double rehash_ns;
+  double rehash_max_ns;
+  long max_stack_depth;
+  long allocs;
+  long frees;
+} Rpn_stats;
+
+extern __thread Rpn_stats rpn_stats;
+
+double stats_now_ns();
+void stats_rehash_time(double start);
+void stats_print_json(FILE *out, char *filename);
+void stats_reset();
+
+#define STATS_INC(field) (rpn_stats.field++)
+#define STATS_MAX(field, val) \
+  do { if((val) > rpn_stats.field) rpn_stats.field = (val); } while(0)
+#define STATS_TIMER(start) double start = stats_now_ns()
+#define STATS_REHASH_TIME(start) stats_rehash_time(start)
+#define STATS_DUMP(filename) \
+  do { stats_print_json(stderr, (filename)); stats_reset(); } while(0)
+#define STATS_POOL(pool, name) pool_print_stats((pool), (name))
+
+#else
+
+#define STATS_INC(field) ((void)0)
+#define STATS_MAX(field, val) ((void)0)
+#define STATS_TIMER(start) ((void)0)
+#define STATS_REHASH_TIME(start) ((void)0)
+#define STATS_DUMP(filename) ((void)0)
+#define STATS_POOL(pool, name) ((void)0)
+
+#endif
+
+#endif
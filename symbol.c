@@ -18,7 +18,8 @@ Symbol *symbol_create(char *variable, int value) {
   sym->next = NULL;
   sym->val = value;
   if(variable != NULL) {
-    strncpy(sym->variable, variable, MAX_VAR_LEN);
+    strncpy(sym->variable, variable, MAX_VAR_LEN - 1);
+    sym->variable[MAX_VAR_LEN - 1] = '\0';
   }
   return sym;
 }
@@ -45,3 +46,28 @@ void symbol_free(Symbol *sym) {
   sym = NULL;
   return;
 }
+
+/* Creates a new symbol in pool instead of on the Heap.
+ * Will initialize val and variable (if not NULL).
+ * Returns NULL on any memory errors.
+ */
+Symbol *symbol_create_pooled(Pool *pool, char *variable, int value) {
+  Symbol *sym = pool_alloc(pool);
+  if(sym == NULL) {
+    return NULL;
+  }
+
+  sym->next = NULL;
+  sym->val = value;
+  if(variable != NULL) {
+    strncpy(sym->variable, variable, MAX_VAR_LEN - 1);
+    sym->variable[MAX_VAR_LEN - 1] = '\0';
+  }
+  return sym;
+}
+
+/* Returns a symbol made by symbol_create_pooled to its pool.
+ */
+void symbol_free_pooled(Pool *pool, Symbol *sym) {
+  pool_free(pool, sym);
+}
@@ -2,6 +2,8 @@
 #ifndef SYMBOL_H
 #define SYMBOL_H
 
+#include "pool.h"
+
 #define MAX_VAR_LEN 20
 
 /* Symbol Structure
@@ -16,21 +18,56 @@ typedef struct symbol_struct {
   struct symbol_struct *next;
 } Symbol;
 
+/* Kinds of Symbol Table */
+#define HASH_CHAINED    0
+#define HASH_OPEN       1
+#define HASH_CONCURRENT 2
+
 /* Symbol Table Structure
+ * kind is HASH_CHAINED, HASH_OPEN or HASH_CONCURRENT
  * size is the number of current indices that have data in them.
  * capacity is the total number of indices in the table (array)
  * table is an array of Symbol *s, it's an array of node pointers.
  * -- Since it's a pointer to an array of Symbol* types, it's a Symbol**
+ * -- (HASH_CHAINED only)
+ * old_table and old_capacity are the previous table while a rehash is in
+ * -- progress (old_table is NULL otherwise); chains before index migrate
+ * -- have already been moved into table. (HASH_CHAINED only)
+ * pool is where the table's Symbols are allocated from; they are all
+ * -- released together when the table is destroyed. (HASH_CHAINED and
+ * -- HASH_CONCURRENT)
+ * slots is a flat array holding the Symbols themselves, probed linearly
+ * -- (HASH_OPEN only)
+ * map and map_len are the snapshot file slots is mapped from (see
+ * -- snapshot_load), or NULL if slots was malloc'd (HASH_OPEN only)
+ * ctab is the lock and slot array lookups go through without locking
+ * -- (HASH_CONCURRENT only, see ctab.h)
+ * base is the shared table an overlay falls through to, or NULL if this
+ * -- is not an overlay (see hash_initialize_overlay); shadows is how many
+ * -- of the overlay's own Symbols hide one of base's
  */
 typedef struct symtab_struct {
+  int kind;
   int size;
   int capacity;
   Symbol **table;
+  Symbol **old_table;
+  int old_capacity;
+  int migrate;
+  Pool *pool;
+  Symbol *slots;
+  void *map;
+  size_t map_len;
+  struct ctab_struct *ctab;
+  struct symtab_struct *base;
+  int shadows;
 } Symtab;
 
 /* Function Prototypes */
 Symbol *symbol_create(char *variable, int value);
 Symbol *symbol_copy(Symbol *sym);
 void symbol_free(Symbol *sym);
+Symbol *symbol_create_pooled(Pool *pool, char *variable, int value);
+void symbol_free_pooled(Pool *pool, Symbol *sym);
 
 #endif
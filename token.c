@@ -1,75 +1,145 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "token.h"
 
-/* These are globals that are restricted to this one file only.
+/* The shared context used by the context-free token_* functions, and the
+ * private copy of the line it tokenizes.  Both are restricted to this one
+ * file only.
  */
-/* Main Buffer (will be eaten by strtok) */
-static char *buffer = NULL;
-/* Copy Buffer */
-static char *cbuf = NULL;
-/* Pointers to each Buffer (will follow same jumps) */
-static char *p_buf = NULL;
-static char *p_cbuf = NULL;
+static Token_ctx global_ctx = { NULL, 0, 0, 0, 0 };
+static char *global_line = NULL;
 
-/* Clean any buffer values in use */
-static void clean_buffer() {
-  if(buffer != NULL) {
-    free(buffer);
-    buffer = NULL;
-    p_buf = NULL;
+/* Returns 1 if c separates symbols (programs may span several lines) */
+int token_is_delimiter(char c) {
+  return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
+/* Moves ctx->pos forward to the start of the next symbol */
+static void skip_delimiters(Token_ctx *ctx) {
+  while(ctx->pos < ctx->size && token_is_delimiter(ctx->input[ctx->pos])) {
+    ctx->pos++;
   }
-  if(cbuf != NULL) {
-    free(cbuf);
-    cbuf = NULL;
-    p_cbuf = NULL;
+}
+
+/* Creates a new, empty tokenizer context on the Heap.
+ * Returns NULL on any memory errors.
+ */
+Token_ctx *token_ctx_initialize() {
+  Token_ctx *ctx = malloc(sizeof(Token_ctx));
+  if(ctx == NULL) {
+    return NULL;
+  }
+
+  ctx->input = NULL;
+  ctx->size = 0;
+  ctx->pos = 0;
+  ctx->rest = 0;
+  ctx->more = 0;
+  return ctx;
+}
+
+/* Destroys a tokenizer context.  The input buffer belongs to the caller.
+ */
+void token_ctx_destroy(Token_ctx *ctx) {
+  free(ctx);
+}
+
+/* Points ctx at a line (or chunk) of the program to tokenize.
+ * The string is not copied, so it must stay untouched until every symbol
+ *   in it has been read.
+ * Returns -1 if ctx or string is NULL or if string is empty.
+ * Otherwise, returns 0
+ */
+int token_ctx_read_line(Token_ctx *ctx, char *string, int size) {
+  if(ctx == NULL || string == NULL || string[0] == '\0') {
+    return -1;
   }
+
+  ctx->input = string;
+  ctx->size = size;
+  ctx->pos = 0;
+  ctx->rest = 0;
+  skip_delimiters(ctx);
+  return 0;
 }
 
-/* Initializes the buffers with a new string to parse */
-static int assign_buffer(char *string, int size) {
-  /* Clear the buffers responsibly first */
-  clean_buffer();
+/* Marks whether more of the program follows the chunk ctx points at, so
+ *   the remaining program is shown as cut off rather than ending there.
+ */
+void token_ctx_set_more(Token_ctx *ctx, int more) {
+  if(ctx != NULL) {
+    ctx->more = more;
+  }
+}
 
-  /* Allocate new buffers */
-  buffer = malloc(size + 1);
-  cbuf = malloc(size + 1);
+/* Returns 1 if there is at least one symbol left in ctx.
+ */
+int token_ctx_has_next(Token_ctx *ctx) {
+  return (ctx != NULL && ctx->pos < ctx->size);
+}
 
-  if(buffer == NULL || cbuf == NULL) {
+/* Fills view with the offset and length of the next symbol in ctx and
+ *   advances past it.
+ * Returns -1 if there are no more symbols, otherwise 0.
+ */
+int token_ctx_next_view(Token_ctx *ctx, Token_view *view) {
+  if(token_ctx_has_next(ctx) == 0 || view == NULL) {
     return -1;
   }
 
-  /* Copy the string into the two buffers and ensure proper termination */
-  strncpy(buffer, string, size);
-  strncpy(cbuf, string, size);
-  buffer[size] = '\0';
-  cbuf[size] = '\0';
+  view->offset = ctx->pos;
+  while(ctx->pos < ctx->size && !token_is_delimiter(ctx->input[ctx->pos])) {
+    ctx->pos++;
+  }
+  view->len = ctx->pos - view->offset;
+
+  skip_delimiters(ctx);
+  ctx->rest = ctx->pos;
+  return 0;
+}
+
+/* Decodes the next symbol in ctx into the caller's tok without allocating.
+ * Returns -1 if there are no more symbols, otherwise 0.
+ */
+int token_ctx_next(Token_ctx *ctx, Token *tok) {
+  Token_view view;
+
+  if(tok == NULL || token_ctx_next_view(ctx, &view) != 0) {
+    return -1;
+  }
 
-  /* Prime the main buffer for tokenization */
-  p_buf = strtok(buffer, " ");
-  p_cbuf = cbuf;
+  token_from_view(ctx->input, &view, tok);
   return 0;
 }
 
 /* Main interface with other programs.  Passes in a line from the file
- * Returns -1 if string is NULL or is empty.
+ * The shared context keeps its own copy of the line.
+ * Returns -1 if string is NULL or is empty, or on any memory errors.
  * Otherwise, returns 0
  */
 int token_read_line(char *string, int size) {
   if(string == NULL || string[0] == '\0') {
     return -1;
   }
-  else {
-    return assign_buffer(string, size);
+
+  free(global_line);
+  global_line = malloc(size + 1);
+  if(global_line == NULL) {
+    return -1;
   }
+  strncpy(global_line, string, size);
+  global_line[size] = '\0';
+
+  return token_ctx_read_line(&global_ctx, global_line, size);
 }
 
-/* If strtok hasn't returned NULL into p_buf, we have at least one symbol left.
+/* Returns 1 if the shared context has at least one symbol left.
  */
 int token_has_next() {
-  return (p_buf != NULL);
+  return token_ctx_has_next(&global_ctx);
 }
 
 Token *token_create_value(int val) {
@@ -83,43 +153,36 @@ Token *token_create_value(int val) {
   return tok;
 }
 
-/* If the next symbol represents an operator, assign the codes here. */
-static int get_operator(char *p_buf) {
-  if(strncmp(p_buf, "+", 1) == 0) {
-    return OPERATOR_PLUS;
-  }
-  else if (strncmp(p_buf, "-", 1) == 0) {
-    return OPERATOR_MINUS;
-  }
-  else if (strncmp(p_buf, "*", 1) == 0) {
-    return OPERATOR_MULT;
-  }
-  else if (strncmp(p_buf, "/", 1) == 0) {
-    return OPERATOR_DIV;
-  }
-  else {
+/* If the symbol represents an operator, returns its code, otherwise -1.
+ * Operators are always a single character, so "-5" is a value.
+ */
+static int get_operator(char *sym, int len) {
+  if(len != 1) {
     return -1;
   }
-}
 
-/* Returns 1 if the next symbol is print */
-static int is_print(char *p_buf) {
-  return (strncmp(p_buf, "print", 5) == 0);
+  switch(sym[0]) {
+    case '+': return OPERATOR_PLUS;
+    case '-': return OPERATOR_MINUS;
+    case '*': return OPERATOR_MULT;
+    case '/': return OPERATOR_DIV;
+    default: return -1;
+  }
 }
 
-/* Returns 1 if the next symbol is an operator */
-static int is_operator(char *p_buf) {
-  return (get_operator(p_buf) != -1);
+/* Returns 1 if the symbol is print */
+static int is_print(char *sym, int len) {
+  return (len == 5 && strncmp(sym, "print", 5) == 0);
 }
 
-/* Returns 1 if the next symbol is '=' for assignment */
-static int is_assignment(char *p_buf) {
-  return (p_buf[0] == '=');
+/* Returns 1 if the symbol is '=' for assignment */
+static int is_assignment(char *sym, int len) {
+  return (sym[0] == '=');
 }
 
-/* Returns 1 if the next symbol is a value */
-static int is_value(char *p_buf) {
-  if((p_buf[0] >= '0' && p_buf[0] <= '9') || p_buf[0] == '-') {
+/* Returns 1 if the symbol is a value */
+static int is_value(char *sym, int len) {
+  if((sym[0] >= '0' && sym[0] <= '9') || sym[0] == '-') {
     return 1;
   }
   else {
@@ -127,60 +190,132 @@ static int is_value(char *p_buf) {
   }
 }
 
-/* Internal function to create a new token and perform the assignments */
-static Token *create_token() {
-  Token *tok = malloc(sizeof(Token));
-  if(tok == NULL) {
-    return NULL;
+/* Converts the leading digits of a value symbol, like strtol would,
+ * without reading past the end of the symbol.  Values too big for an int
+ * saturate at INT_MAX or INT_MIN.
+ */
+static int get_value(char *sym, int len) {
+  long limit = INT_MAX;
+  long val = 0;
+  int neg = 0;
+  int i = 0;
+
+  if(sym[0] == '-') {
+    neg = 1;
+    limit = -(long)INT_MIN;
+    i = 1;
   }
-  if(is_operator(p_buf)) {
+  for(; i < len && sym[i] >= '0' && sym[i] <= '9'; i++) {
+    val = val * 10 + (sym[i] - '0');
+    //Stop before a long run of digits can overflow val
+    if(val > limit) {
+      val = limit;
+      break;
+    }
+  }
+  return (int)(neg ? -val : val);
+}
+
+/* Decodes the symbol that view points at inside input into tok.
+ * Nothing is allocated; variable names are copied into tok itself.
+ */
+void token_from_view(char *input, Token_view *view, Token *tok) {
+  char *sym = input + view->offset;
+  int len = view->len;
+  int oper = get_operator(sym, len);
+
+  if(oper != -1) {
     tok->type = TYPE_OPERATOR;
-    tok->oper = get_operator(p_buf);
+    tok->oper = oper;
   }
-  else if(is_assignment(p_buf)) {
+  else if(is_assignment(sym, len)) {
     tok->type = TYPE_ASSIGNMENT;
   }
-  else if(is_print(p_buf)) {
+  else if(is_print(sym, len)) {
     tok->type = TYPE_PRINT;
   }
-  else if(is_value(p_buf)) {
+  else if(is_value(sym, len)) {
     tok->type = TYPE_VALUE;
-    tok->value = strtol(p_buf, NULL, 10);
+    tok->value = get_value(sym, len);
   }
   else {
     tok->type = TYPE_VARIABLE;
-    strncpy(tok->variable, p_buf, MAX_VARIABLE_LEN);
+    if(len >= MAX_VARIABLE_LEN) {
+      len = MAX_VARIABLE_LEN - 1;
+    }
+    memcpy(tok->variable, sym, len);
+    tok->variable[len] = '\0';
+  }
+}
+
+/* Creates a token on the Heap from the next symbol in ctx and returns it.
+ * Returns NULL if no more symbols or on any memory errors.
+ */
+Token *token_ctx_get_next(Token_ctx *ctx) {
+  Token *tok = NULL;
+
+  if(token_ctx_has_next(ctx) == 0) {
+    return NULL;
+  }
+
+  tok = malloc(sizeof(Token));
+  if(tok == NULL) {
+    return NULL;
   }
+
+  token_ctx_next(ctx, tok);
   return tok;
 }
 
-/* Creates a token from the next symbol and returns it.
+/* Creates a token from the next symbol in the shared context.
  * Returns NULL if no more symbols
  */
 Token *token_get_next() {
-  if(token_has_next() == 0) {
-    return NULL;
-  }
+  return token_ctx_get_next(&global_ctx);
+}
 
-  Token *tok = create_token();
-  /* Advance the two buffers */
-  p_buf = strtok(NULL, " ");
-  p_cbuf = (p_buf-buffer)+cbuf;
+/* Writes out the remaining symbols in ctx to out on one line, with each
+ *   run of delimiters (newlines included) as a single space.  If more of
+ *   the program follows this chunk, the line ends in "...".
+ */
+void token_ctx_write_remaining(Token_ctx *ctx, Outbuf *out) {
+  int start = 0;
+  int i = 0;
 
-  if(p_buf == NULL) {
-    free(buffer);
-    free(cbuf);
+  outbuf_str(out, "|-----Program Remaining\n");
+  if(!token_ctx_has_next(ctx) && !ctx->more) {
+    return;
+  }
+  outbuf_write(out, "|", 1);
+  for(i = ctx->rest; i < ctx->size; i++) {
+    if(token_is_delimiter(ctx->input[i])) {
+      continue;
+    }
+    start = i;
+    while(i < ctx->size && !token_is_delimiter(ctx->input[i])) {
+      i++;
+    }
+    outbuf_write(out, " ", 1);
+    outbuf_write(out, ctx->input + start, i - start);
+  }
+  if(ctx->more) {
+    outbuf_write(out, " ...", 4);
   }
+  outbuf_write(out, "\n", 1);
+}
 
-  return tok;
+/* Prints out the remaining symbols in ctx */
+void token_ctx_print_remaining(Token_ctx *ctx) {
+  Outbuf *out = outbuf_initialize(OUTBUF_MEMORY);
+
+  token_ctx_write_remaining(ctx, out);
+  outbuf_print_stdout(out);
+  outbuf_destroy(out);
 }
 
-/* Prints out the remaining symbols */
+/* Prints out the remaining symbols in the shared context */
 void token_print_remaining() {
-  printf("|-----Program Remaining\n");
-  if(token_has_next()) {
-    printf("| %s", p_cbuf);
-  }
+  token_ctx_print_remaining(&global_ctx);
 }
 
 /* Frees a token */
@@ -189,30 +324,41 @@ void token_free(Token *tok) {
   tok = NULL;
 }
 
-/* Prints a token */
-void token_print(Token *tok) {
+/* Writes a token to out */
+void token_write(Token *tok, Outbuf *out) {
   if(tok == NULL) {
     return;
   }
   else if(tok->type == TYPE_OPERATOR) {
     switch(tok->oper) {
-      case OPERATOR_PLUS: printf("+ "); break;
-      case OPERATOR_MINUS: printf("- "); break;
-      case OPERATOR_MULT: printf("* "); break;
-      case OPERATOR_DIV: printf("/ "); break;
-      default: printf(" "); break;
+      case OPERATOR_PLUS: outbuf_write(out, "+ ", 2); break;
+      case OPERATOR_MINUS: outbuf_write(out, "- ", 2); break;
+      case OPERATOR_MULT: outbuf_write(out, "* ", 2); break;
+      case OPERATOR_DIV: outbuf_write(out, "/ ", 2); break;
+      default: outbuf_write(out, " ", 1); break;
     }
   }
   else if(tok->type == TYPE_PRINT) {
-    printf("print ");
+    outbuf_write(out, "print ", 6);
   }
   else if(tok->type == TYPE_ASSIGNMENT) {
-    printf("= ");
+    outbuf_write(out, "= ", 2);
   }
   else if(tok->type == TYPE_VALUE) {
-    printf("%d ", tok->value);
+    outbuf_int(out, tok->value);
+    outbuf_write(out, " ", 1);
   }
   else {
-    printf("%s ", tok->variable);
+    outbuf_str(out, tok->variable);
+    outbuf_write(out, " ", 1);
   }
 }
+
+/* Prints a token */
+void token_print(Token *tok) {
+  Outbuf *out = outbuf_initialize(OUTBUF_MEMORY);
+
+  token_write(tok, out);
+  outbuf_print_stdout(out);
+  outbuf_destroy(out);
+}
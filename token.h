@@ -15,6 +15,8 @@
 
 #define MAX_VARIABLE_LEN 20
 
+#include "outbuf.h"
+
 /* Struct definition for Tokens */
 typedef struct token_struct {
   int type;
@@ -23,13 +25,57 @@ typedef struct token_struct {
   int value;
 } Token;
 
-/* Token Related Prototypes */
+/* Token View
+ * A symbol in the input, given as its offset and length.  Views point
+ * straight into the caller's buffer; nothing is copied or allocated.
+ */
+typedef struct token_view_struct {
+  int offset;
+  int len;
+} Token_view;
+
+/* Tokenizer Context
+ * Holds all of the state for tokenizing one program, so several programs
+ * can be tokenized at once (eg. on different threads).
+ * input is the caller's buffer (not copied, must outlive the tokenizing)
+ * size is the number of bytes of input to tokenize
+ * pos is the offset of the next symbol (size if there are none left)
+ * rest is the offset that token_ctx_print_remaining prints from
+ * more is set when input is one chunk of a longer program and more of it
+ * -- follows (see token_ctx_set_more)
+ */
+typedef struct token_ctx_struct {
+  char *input;
+  int size;
+  int pos;
+  int rest;
+  int more;
+} Token_ctx;
+
+/* Tokenizer Context Prototypes */
+Token_ctx *token_ctx_initialize();
+void token_ctx_destroy(Token_ctx *ctx);
+int token_ctx_read_line(Token_ctx *ctx, char *string, int size);
+void token_ctx_set_more(Token_ctx *ctx, int more);
+int token_ctx_has_next(Token_ctx *ctx);
+int token_ctx_next_view(Token_ctx *ctx, Token_view *view);
+int token_ctx_next(Token_ctx *ctx, Token *tok);
+Token *token_ctx_get_next(Token_ctx *ctx);
+void token_ctx_print_remaining(Token_ctx *ctx);
+void token_ctx_write_remaining(Token_ctx *ctx, Outbuf *out);
+void token_from_view(char *input, Token_view *view, Token *tok);
+
+/* Token Related Prototypes
+ * The context-free versions work on one shared, process-wide context.
+ */
+int token_is_delimiter(char c);
 int token_read_line(char *string, int size);
 int token_has_next();
 Token *token_create_value(int val);
 Token *token_get_next();
 void token_print_remaining();
 void token_print(Token *token);
+void token_write(Token *token, Outbuf *out);
 void token_free(Token *token);
 
 #endif